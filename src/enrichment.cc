@@ -10,6 +10,79 @@
 
 namespace cycamore {
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void SwuFeedBatch(double feed_assay, double tails_assay,
+                  const std::vector<double>& product_assays,
+                  const std::vector<double>& product_qtys,
+                  std::vector<double>* swu, std::vector<double>* feed) {
+  if (product_qtys.size() != product_assays.size()) {
+    throw cyclus::ValueError("SwuFeedBatch needs one quantity per product "
+                             "assay");
+  }
+
+  int n = product_assays.size();
+  swu->resize(n);
+  feed->resize(n);
+  if (n == 0) {
+    return;
+  }
+
+  double vf = (2 * feed_assay - 1) * std::log(feed_assay / (1 - feed_assay));
+  double vt = (2 * tails_assay - 1) *
+              std::log(tails_assay / (1 - tails_assay));
+  double inv_ft = 1 / (feed_assay - tails_assay);
+
+  const double* xp = &product_assays[0];
+  const double* qp = &product_qtys[0];
+  double* s = &(*swu)[0];
+  double* f = &(*feed)[0];
+  for (int i = 0; i < n; ++i) {
+    double vp = (2 * xp[i] - 1) * std::log(xp[i] / (1 - xp[i]));
+    double fq = qp[i] * (xp[i] - tails_assay) * inv_ft;
+    s[i] = qp[i] * vp + (fq - qp[i]) * vt - fq * vf;
+    f[i] = fq;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double CascadeTable::Value(double assay) {
+  return (2 * assay - 1) * std::log(assay / (1 - assay));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeTable::Build(double feed, double tails_min, double tails_max,
+                         int n_tails) {
+  tails_.resize(n_tails);
+  vtails_.resize(n_tails);
+  for (int k = 0; k < n_tails; k++) {
+    tails_[k] = tails_min;
+    if (n_tails > 1) {
+      tails_[k] += k * (tails_max - tails_min) / (n_tails - 1);
+    }
+    vtails_[k] = Value(tails_[k]);
+  }
+  SetFeed(feed);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeTable::SetFeed(double feed) {
+  feed_ = feed;
+  vfeed_ = Value(feed);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double CascadeTable::SwuPerKg(double product, double vproduct,
+                              int tails_index) const {
+  double vt = vtails_[tails_index];
+  return vproduct - vt - FeedPerKg(product, tails_index) * (vfeed_ - vt);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double CascadeTable::FeedPerKg(double product, int tails_index) const {
+  double tails = tails_[tails_index];
+  return (product - tails) / (feed_ - tails);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Enrichment::Enrichment(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
@@ -21,7 +94,18 @@ Enrichment::Enrichment(cyclus::Context* ctx)
       feed_recipe(""),
       product_commod(""),
       tails_commod(""),
-      order_prefs(true){}
+      order_prefs(true),
+      consolidate_tails(false),
+      batch_enrich(false),
+      aggregate_enrichments(false),
+      cascade_mode(false),
+      cascade_tails_min(0.001),
+      cascade_tails_max(0.004),
+      cascade_ntails(31),
+      cascade_tails_index_(0),
+      agg_count_(0),
+      feed_u235(0),
+      feed_u238(0) {}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Enrichment::~Enrichment() {}
@@ -46,9 +130,10 @@ void Enrichment::Build(cyclus::Agent* parent) {
 
   Facility::Build(parent);
   if (initial_feed > 0) {
-    inventory.Push(
-      Material::Create(
-        this, initial_feed, context()->GetRecipe(feed_recipe)));
+    Material::Ptr mat =
+      Material::Create(this, initial_feed, context()->GetRecipe(feed_recipe));
+    inventory.Push(mat);
+    TrackFeed_(mat, 1);
   }
 
   LOG(cyclus::LEV_DEBUG2, "EnrFac") << "Enrichment "
@@ -56,9 +141,32 @@ void Enrichment::Build(cyclus::Agent* parent) {
   LOG(cyclus::LEV_DEBUG2, "EnrFac") << str();
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::EnterNotify() {
+  cyclus::Facility::EnterNotify();
+
+  if (!cascade_mode) {
+    return;
+  }
+
+  double feed_assay = cyclus::toolkit::UraniumAssay(
+      cyclus::Material::CreateUntracked(1, context()->GetRecipe(feed_recipe)));
+  if (cascade_ntails < 1 || cascade_tails_min <= 0 ||
+      cascade_tails_min > cascade_tails_max ||
+      cascade_tails_max >= feed_assay) {
+    std::stringstream ss;
+    ss << "prototype '" << prototype() << "' needs 0 < cascade_tails_min <= "
+       << "cascade_tails_max < feed assay (" << feed_assay
+       << ") and cascade_ntails >= 1";
+    throw cyclus::ValidationError(ss.str());
+  }
+  BuildCascade_(feed_assay);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Enrichment::Tick() {
   current_swu_capacity = SwuCapacity();
+  agg_count_ = 0;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -72,6 +180,14 @@ void Enrichment::Tock() {
                                    << " used " << intra_timestep_feed_
                                    << " feed";
   RecordTimeSeries<cyclus::toolkit::ENRICH_FEED>(this, intra_timestep_feed_);
+
+  if (aggregate_enrichments && agg_count_ > 0) {
+    RecordAggregateEnrichments_();
+  }
+
+  if (consolidate_tails) {
+    ConsolidateTails_();
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -95,18 +211,27 @@ std::set<cyclus::RequestPortfolio<cyclus::Material>::Ptr>
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool SortBids(
-    cyclus::Bid<cyclus::Material>* i, cyclus::Bid<cyclus::Material>* j) {
-
-  cyclus::Material::Ptr mat_i = i->offer();
-  cyclus::Material::Ptr mat_j = j->offer();
+// U-235 mass fraction of a composition, memoized by composition id so that
+// offers sharing a recipe are only queried once
+double U235MassFrac(cyclus::Composition::Ptr comp,
+                    std::map<int, double>* cache) {
+  std::map<int, double>::iterator it = cache->find(comp->id());
+  if (it != cache->end()) {
+    return it->second;
+  }
+  cyclus::CompMap cm = comp->mass();
+  cyclus::compmath::Normalize(&cm);
+  double frac = cm.count(922350000) > 0 ? cm[922350000] : 0;
+  (*cache)[comp->id()] = frac;
+  return frac;
+}
 
-  cyclus::toolkit::MatQuery mq_i(mat_i);
-  cyclus::toolkit::MatQuery mq_j(mat_j);
+typedef std::pair<double, cyclus::Bid<cyclus::Material>*> KeyedBid;
 
-  return ((mq_i.mass(922350000) / mq_i.qty()) <=
-	  (mq_j.mass(922350000) / mq_j.qty()));
+bool SortBids(const KeyedBid& i, const KeyedBid& j) {
+  return i.first < j.first;
 }
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Sort offers of input material to have higher preference for more
 //  U-235 content
@@ -121,20 +246,24 @@ void Enrichment::AdjustMatlPrefs(
     return;
   }
 
+  // the same offers are typically seen by every request, so sort keys are
+  // computed once per composition for the whole preference map
+  std::map<int, double> u235_fracs;
   cyclus::PrefMap<cyclus::Material>::type::iterator reqit;
 
   // Loop over all requests
   for (reqit = prefs.begin(); reqit != prefs.end(); ++reqit) {
-    std::vector<Bid<Material>* > bids_vector;    
+    std::vector<KeyedBid> bids_vector;
+    bids_vector.reserve(reqit->second.size());
     std::map<Bid<Material>*, double>::iterator mit;
     for (mit = reqit->second.begin(); mit != reqit->second.end(); ++mit) {
       Bid<Material>* bid = mit->first;
-      bids_vector.push_back(bid);
+      double frac = U235MassFrac(bid->offer()->comp(), &u235_fracs);
+      bids_vector.push_back(std::make_pair(frac, bid));
     }
-    std::sort (bids_vector.begin(), bids_vector.end(), SortBids); 
+    std::stable_sort(bids_vector.begin(), bids_vector.end(), SortBids);
 
     // Assign preferences to the sorted vector
-    double n_bids = bids_vector.size();
     bool u235_mass = 0;
 
     for (int bidit = 0 ; bidit < bids_vector.size(); bidit++) {
@@ -142,16 +271,14 @@ void Enrichment::AdjustMatlPrefs(
       
       // For any bids with U-235 qty=0, set pref to zero. 
       if (!u235_mass) {
-	cyclus::Material::Ptr mat = bids_vector[bidit]->offer();
-	cyclus::toolkit::MatQuery mq(mat);
-	if (mq.mass(922350000) == 0) {
+	if (bids_vector[bidit].first == 0) {
 	  new_pref = -1;
 	}
 	else {
 	  u235_mass = true;
 	}
       }
-      (reqit->second)[bids_vector[bidit]] = new_pref;
+      (reqit->second)[bids_vector[bidit].second] = new_pref;
     } // each bid
   } // each Material Request
 }
@@ -182,22 +309,36 @@ std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr> Enrichment::GetMatlBids(
 
   std::set<BidPortfolio<Material>::Ptr> ports;
 
+  tails_offer_bins_.clear();
   if ((out_requests.count(tails_commod) > 0) && (tails.quantity() > 0)) {
     BidPortfolio<Material>::Ptr tails_port(new BidPortfolio<Material>());
     
+    // offer bids for all tails material, keeping discrete quantities
+    // (or assay bins) to preserve possible variation in composition. The
+    // offers are shared by all requests; trades are split from the tails
+    // inventory in GetMatlTrades.
+    MatVec mats = tails.PopN(tails.count());
+    tails.Push(mats);
+    if (!tails_assay_bins.empty()) {
+      std::vector<int> bins;
+      mats = BinTails_(mats, &bins);
+      for (int k = 0; k < mats.size(); k++) {
+        tails_offer_bins_[mats[k].get()] = bins[k];
+        // each bin can only be traded up to its own quantity
+        Converter<Material>::Ptr bc(new TailsBinConverter(mats[k]));
+        tails_port->AddConstraint(
+            CapacityConstraint<Material>(mats[k]->quantity(), bc));
+      }
+    }
+
     std::vector<Request<Material>*>& tails_requests =
       out_requests[tails_commod];
     std::vector<Request<Material>*>::iterator it;
     for (it = tails_requests.begin(); it != tails_requests.end(); ++it) {
-      // offer bids for all tails material, keeping discrete quantities
-      // to preserve possible variation in composition 
-      MatVec mats = tails.PopN(tails.count());
-      tails.Push(mats);
+      Request<Material>* req = *it;
       for (int k = 0; k < mats.size(); k++) {
-        Material::Ptr m = mats[k];
-	Request<Material>* req = *it;
-	tails_port->AddBid(req, m, this);
-	}
+	tails_port->AddBid(req, mats[k], this);
+      }
     }
     // overbidding (bidding on every offer)
     // add an overall capacity constraint 
@@ -214,6 +355,9 @@ std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr> Enrichment::GetMatlBids(
     
     std::vector<Request<Material>*>& commod_requests =
       out_requests[product_commod];
+    std::vector<Request<Material>*> valid_reqs;
+    std::vector<double> product_assays;
+    std::vector<double> product_qtys;
     std::vector<Request<Material>*>::iterator it;
     for (it = commod_requests.begin(); it != commod_requests.end(); ++it) {
       Request<Material>* req = *it;
@@ -222,13 +366,32 @@ std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr> Enrichment::GetMatlBids(
       if (ValidReq(req->target()) &&
           ((request_enrich < max_enrich) ||
 	   (cyclus::AlmostEq(request_enrich, max_enrich)))) {
-        Material::Ptr offer = Offer_(req->target());
-        commod_port->AddBid(req, offer, this);
+        valid_reqs.push_back(req);
+        product_assays.push_back(request_enrich);
+        product_qtys.push_back(mat->quantity());
       }
     }
 
-    Converter<Material>::Ptr sc(new SWUConverter(FeedAssay(), tails_assay));
-    Converter<Material>::Ptr nc(new NatUConverter(FeedAssay(), tails_assay));
+    if (cascade_mode && !ChooseCascadeTails_(product_assays, product_qtys)) {
+      LOG(cyclus::LEV_INFO4, "EnrFac") << prototype()
+                                       << " has no cascade tails assay below"
+                                       << " its feed assay of " << FeedAssay();
+      return ports;
+    }
+
+    for (int i = 0; i < valid_reqs.size(); i++) {
+      Material::Ptr offer = Offer_(valid_reqs[i]->target());
+      commod_port->AddBid(valid_reqs[i], offer, this);
+    }
+
+    Converter<Material>::Ptr sc;
+    if (cascade_mode) {
+      sc.reset(new SWUConverter(&cascade_, cascade_tails_index_));
+    } else {
+      sc.reset(new SWUConverter(FeedAssay(), tails_assay));
+    }
+    Converter<Material>::Ptr nc(
+        new NatUConverter(FeedAssay(), TailsAssay_()));
     CapacityConstraint<Material> swu(swu_capacity, sc);
     CapacityConstraint<Material> natu(inventory.quantity(), nc);
     commod_port->AddConstraint(swu);
@@ -245,12 +408,122 @@ std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr> Enrichment::GetMatlBids(
   return ports;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int Enrichment::TailsBin_(cyclus::Material::Ptr mat) {
+  double assay = cyclus::toolkit::UraniumAssay(mat);
+  return std::lower_bound(tails_assay_bins.begin(), tails_assay_bins.end(),
+                          assay) - tails_assay_bins.begin();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+cyclus::toolkit::MatVec Enrichment::BinTails_(
+    const cyclus::toolkit::MatVec& mats, std::vector<int>* bins) {
+  using cyclus::CompMap;
+  using cyclus::Material;
+
+  std::map<int, CompMap> bin_comps;
+  std::map<int, double> bin_qtys;
+  for (int k = 0; k < mats.size(); k++) {
+    Material::Ptr m = mats[k];
+    int bin = TailsBin_(m);
+    CompMap cm = m->comp()->mass();
+    cyclus::compmath::Normalize(&cm, m->quantity());
+    bin_comps[bin] = cyclus::compmath::Add(bin_comps[bin], cm);
+    bin_qtys[bin] += m->quantity();
+  }
+
+  cyclus::toolkit::MatVec offers;
+  bins->clear();
+  std::map<int, double>::iterator it;
+  for (it = bin_qtys.begin(); it != bin_qtys.end(); ++it) {
+    if (it->second > cyclus::eps()) {
+      offers.push_back(Material::CreateUntracked(
+          it->second,
+          cyclus::Composition::CreateFromMass(bin_comps[it->first])));
+      bins->push_back(it->first);
+    }
+  }
+  return offers;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+cyclus::Material::Ptr Enrichment::PopTailsBin_(double qty, int bin) {
+  using cyclus::Material;
+  using cyclus::toolkit::MatVec;
+
+  MatVec mats = tails.PopN(tails.count());
+  MatVec rest;
+  Material::Ptr response;
+  for (int k = 0; k < mats.size(); k++) {
+    Material::Ptr m = mats[k];
+    if (qty <= cyclus::eps() || TailsBin_(m) != bin) {
+      rest.push_back(m);
+      continue;
+    }
+
+    Material::Ptr piece = m;
+    if (m->quantity() - qty > cyclus::eps()) {
+      piece = m->ExtractQty(qty);
+      rest.push_back(m);
+    }
+    qty -= piece->quantity();
+    if (!response) {
+      response = piece;
+    } else {
+      response->Absorb(piece);
+    }
+  }
+  tails.Push(rest);
+
+  if (qty > cyclus::eps() && tails.quantity() > cyclus::eps()) {
+    Material::Ptr extra = tails.Pop(std::min(qty, tails.quantity()));
+    if (!response) {
+      response = extra;
+    } else {
+      response->Absorb(extra);
+    }
+  }
+  return response;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::ConsolidateTails_() {
+  using cyclus::Material;
+  using cyclus::toolkit::MatVec;
+
+  if (tails.count() < 2) {
+    return;
+  }
+
+  // absorbing keeps every original lot in the resource log; bins keep the
+  // order of their oldest lot
+  MatVec mats = tails.PopN(tails.count());
+  std::map<int, int> bin_lots;
+  MatVec merged;
+  for (int k = 0; k < mats.size(); k++) {
+    int bin = TailsBin_(mats[k]);
+    std::map<int, int>::iterator it = bin_lots.find(bin);
+    if (it == bin_lots.end()) {
+      bin_lots[bin] = merged.size();
+      merged.push_back(mats[k]);
+    } else {
+      merged[it->second]->Absorb(mats[k]);
+    }
+  }
+  tails.Push(merged);
+
+  LOG(cyclus::LEV_DEBUG2, "EnrFac") << prototype() << " consolidated "
+                                    << mats.size() << " tails lots into "
+                                    << merged.size();
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool Enrichment::ValidReq(const cyclus::Material::Ptr mat) {
   cyclus::toolkit::MatQuery q(mat);
   double u235 = q.atom_frac(922350000);
   double u238 = q.atom_frac(922380000);
-  return (u238 > 0 && u235 / (u235 + u238) > tails_assay);
+  double tails = cascade_mode ? cascade_tails_max : tails_assay;
+  return (u238 > 0 && u235 / (u235 + u238) > tails);
 }
   
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -265,6 +538,7 @@ void Enrichment::GetMatlTrades(
   intra_timestep_swu_ = 0;
   intra_timestep_feed_ = 0;
 
+  std::vector< Trade<Material> > batch;
   std::vector< Trade<Material> >::const_iterator it;
   for (it = trades.begin(); it != trades.end(); ++it) {
     double qty = it->amt;
@@ -278,17 +552,31 @@ void Enrichment::GetMatlTrades(
 				       << " just received an order"
 				       << " for " << it->amt
 				       << " of " << tails_commod;
-      response = tails.Pop(std::min(qty, tails.quantity()));    
+      std::map<Material*, int>::iterator bin =
+          tails_offer_bins_.find(it->bid->offer().get());
+      if (bin != tails_offer_bins_.end()) {
+        response = PopTailsBin_(qty, bin->second);
+      } else {
+        response = tails.Pop(std::min(qty, tails.quantity()));
+      }
     } else {
       LOG(cyclus::LEV_INFO5, "EnrFac") << prototype()
 				       << " just received an order"
 				       << " for " << it->amt
 				       << " of " << product_commod;
+      if (batch_enrich) {
+        batch.push_back(*it);
+        continue;
+      }
       response = Enrich_(it->bid->offer(), qty);
     }
     responses.push_back(std::make_pair(*it, response));	
   }
 
+  if (!batch.empty()) {
+    EnrichBatch_(batch, responses);
+  }
+
   if (cyclus::IsNegative(tails.quantity())) {
     std::stringstream ss;
     ss << "is being asked to provide more than its current inventory.";
@@ -337,6 +625,7 @@ void Enrichment::AddMat_(cyclus::Material::Ptr mat) {
     e.msg(Agent::InformErrorMsg(e.msg()));
     throw e;
   }
+  TrackFeed_(mat, 1);
 
   LOG(cyclus::LEV_INFO5, "EnrFac") << prototype() << " added "
                                    << mat->quantity() << " of " << feed_commod
@@ -354,11 +643,20 @@ cyclus::Material::Ptr Enrichment::Request_() {
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 cyclus::Material::Ptr Enrichment::Offer_(cyclus::Material::Ptr mat) {
   cyclus::toolkit::MatQuery q(mat);
-  cyclus::CompMap comp;
-  comp[922350000] = q.atom_frac(922350000);
-  comp[922380000] = q.atom_frac(922380000);
-  return cyclus::Material::CreateUntracked(
-           mat->quantity(), cyclus::Composition::CreateFromAtom(comp));
+  double u235 = q.atom_frac(922350000);
+  double u238 = q.atom_frac(922380000);
+  double assay = u235 / (u235 + u238);
+
+  std::map<double, cyclus::Composition::Ptr>::iterator it =
+      product_comps_.find(assay);
+  if (it == product_comps_.end()) {
+    cyclus::CompMap comp;
+    comp[922350000] = assay;
+    comp[922380000] = 1 - assay;
+    it = product_comps_.insert(std::make_pair(
+        assay, cyclus::Composition::CreateFromAtom(comp))).first;
+  }
+  return cyclus::Material::CreateUntracked(mat->quantity(), it->second);
 }
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 cyclus::Material::Ptr Enrichment::Enrich_(
@@ -374,20 +672,13 @@ cyclus::Material::Ptr Enrichment::Enrich_(
   using cyclus::toolkit::TailsQty;
 
   // get enrichment parameters
-  Assays assays(FeedAssay(), UraniumAssay(mat), tails_assay);
-  double swu_req = SwuRequired(qty, assays);
+  Assays assays(FeedAssay(), UraniumAssay(mat), TailsAssay_());
+  double swu_req = SwuRequired_(qty, assays);
   double natu_req = FeedQty(qty, assays);
 
   // Determine the composition of the natural uranium
   // (ie. U-235+U-238/TotalMass)
-  Material::Ptr natu_matl=inventory.Pop(inventory.quantity());
-  inventory.Push(natu_matl);
-  
-  cyclus::toolkit::MatQuery mq(natu_matl);
-  std::set<cyclus::Nuc> nucs;
-  nucs.insert(922350000);
-  nucs.insert(922380000);
-  double natu_frac = mq.mass_frac(nucs);
+  double natu_frac = (feed_u235 + feed_u238) / inventory.quantity();
   double feed_req = natu_req/natu_frac;
 
   // pop amount from inventory and blob it into one material
@@ -400,7 +691,7 @@ cyclus::Material::Ptr Enrichment::Enrich_(
       r = inventory.Pop(feed_req);
     }
   } catch (cyclus::Error& e) {
-    NatUConverter nc(FeedAssay(), tails_assay);
+    NatUConverter nc(FeedAssay(), TailsAssay_());
     std::stringstream ss;
     ss << " tried to remove " << feed_req
        << " from its inventory of size " << inventory.quantity()
@@ -408,6 +699,7 @@ cyclus::Material::Ptr Enrichment::Enrich_(
        << nc.convert(mat);
     throw cyclus::ValueError(Agent::InformErrorMsg(ss.str()));
   }
+  TrackFeed_(r, -1);
 
   // "enrich" it, but pull out the composition and quantity we require from the
   // blob
@@ -419,7 +711,7 @@ cyclus::Material::Ptr Enrichment::Enrich_(
 
   intra_timestep_swu_ += swu_req;
   intra_timestep_feed_ += feed_req;
-  RecordEnrichment_(feed_req, swu_req);
+  RecordEnrichment_(feed_req, swu_req, qty, assays.Product());
 
   LOG(cyclus::LEV_INFO5, "EnrFac") << prototype() <<
                                 " has performed an enrichment: ";
@@ -444,7 +736,75 @@ cyclus::Material::Ptr Enrichment::Enrich_(
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Enrichment::RecordEnrichment_(double natural_u, double swu) {
+void Enrichment::EnrichBatch_(
+    const std::vector< cyclus::Trade<cyclus::Material> >& trades,
+    std::vector<std::pair<cyclus::Trade<cyclus::Material>,
+    cyclus::Material::Ptr> >& responses) {
+
+  using cyclus::Material;
+  using cyclus::toolkit::UraniumAssay;
+
+  // account SWU and feed for every trade before touching any material
+  double natu_frac = (feed_u235 + feed_u238) / inventory.quantity();
+  std::vector<double> product_assays(trades.size());
+  std::vector<double> product_qtys(trades.size());
+  for (int i = 0; i < trades.size(); i++) {
+    product_assays[i] = UraniumAssay(trades[i].bid->offer());
+    product_qtys[i] = trades[i].amt;
+  }
+  std::vector<double> swu_reqs;
+  std::vector<double> feed_reqs;
+  SwuFeedBatch(FeedAssay(), TailsAssay_(), product_assays, product_qtys,
+               &swu_reqs, &feed_reqs);
+
+  double tot_feed = 0;
+  for (int i = 0; i < trades.size(); i++) {
+    if (cascade_mode) {
+      swu_reqs[i] = product_qtys[i] *
+                    cascade_.SwuPerKg(product_assays[i], cascade_tails_index_);
+    }
+    feed_reqs[i] /= natu_frac;
+    tot_feed += feed_reqs[i];
+  }
+
+  // then withdraw the feed for the whole batch at once
+  Material::Ptr r;
+  try {
+    // required so popping doesn't take out too much
+    if (cyclus::AlmostEq(tot_feed, inventory.quantity())) {
+      r = cyclus::toolkit::Squash(inventory.PopN(inventory.count()));
+    } else {
+      r = inventory.Pop(tot_feed);
+    }
+  } catch (cyclus::Error& e) {
+    std::stringstream ss;
+    ss << " tried to remove " << tot_feed
+       << " from its inventory of size " << inventory.quantity()
+       << " to fill " << trades.size() << " enrichment orders";
+    throw cyclus::ValueError(Agent::InformErrorMsg(ss.str()));
+  }
+  TrackFeed_(r, -1);
+
+  for (int i = 0; i < trades.size(); i++) {
+    Material::Ptr response =
+        r->ExtractComp(trades[i].amt, trades[i].bid->offer()->comp());
+    current_swu_capacity -= swu_reqs[i];
+    intra_timestep_swu_ += swu_reqs[i];
+    intra_timestep_feed_ += feed_reqs[i];
+    RecordEnrichment_(feed_reqs[i], swu_reqs[i], trades[i].amt,
+                      product_assays[i]);
+    responses.push_back(std::make_pair(trades[i], response));
+  }
+  tails.Push(r);
+
+  LOG(cyclus::LEV_INFO5, "EnrFac") << prototype() << " has performed "
+                                   << trades.size() << " enrichments using "
+                                   << tot_feed << " feed";
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::RecordEnrichment_(double natural_u, double swu,
+                                   double product_qty, double product_assay) {
   using cyclus::Context;
   using cyclus::Agent;
 
@@ -453,6 +813,25 @@ void Enrichment::RecordEnrichment_(double natural_u, double swu) {
   LOG(cyclus::LEV_DEBUG1, "EnrFac") << "  * Amount: " << natural_u;
   LOG(cyclus::LEV_DEBUG1, "EnrFac") << "  *    SWU: " << swu;
 
+  if (aggregate_enrichments) {
+    if (agg_count_ == 0) {
+      agg_natu_ = 0;
+      agg_swu_ = 0;
+      agg_product_ = 0;
+      agg_min_assay_ = product_assay;
+      agg_max_assay_ = product_assay;
+    }
+    agg_count_++;
+    agg_natu_ += natural_u;
+    agg_swu_ += swu;
+    agg_product_ += product_qty;
+    agg_min_assay_ = std::min(agg_min_assay_, product_assay);
+    agg_max_assay_ = std::max(agg_max_assay_, product_assay);
+    if (cyclus::Logger::ReportLevel() < cyclus::LEV_DEBUG1) {
+      return;
+    }
+  }
+
   Context* ctx = Agent::context();
   ctx->NewDatum("Enrichments")
       ->AddVal("ID", id())
@@ -461,16 +840,124 @@ void Enrichment::RecordEnrichment_(double natural_u, double swu) {
       ->AddVal("SWU", swu)
       ->Record();
 }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::RecordAggregateEnrichments_() {
+  cyclus::Context* ctx = Agent::context();
+  ctx->NewDatum("AggregateEnrichments")
+      ->AddVal("ID", id())
+      ->AddVal("Time", ctx->time())
+      ->AddVal("Count", agg_count_)
+      ->AddVal("Natural_Uranium", agg_natu_)
+      ->AddVal("SWU", agg_swu_)
+      ->AddVal("Product", agg_product_)
+      ->AddVal("Min_Product_Assay", agg_min_assay_)
+      ->AddVal("Max_Product_Assay", agg_max_assay_)
+      ->Record();
+}
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 double Enrichment::FeedAssay() {
-  using cyclus::Material;
-
   if (inventory.empty()) {
     return 0;
   }
-  cyclus::Material::Ptr fission_matl = inventory.Pop(inventory.quantity());
-  inventory.Push(fission_matl);
-  return cyclus::toolkit::UraniumAssay(fission_matl); 
+  // atom-based, consistent with cyclus::toolkit::UraniumAssay
+  double u235 = feed_u235 / pyne::atomic_mass(922350000);
+  double u238 = feed_u238 / pyne::atomic_mass(922380000);
+  if (u235 + u238 <= 0) {
+    return 0;
+  }
+  return u235 / (u235 + u238);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double Enrichment::TailsAssay_() const {
+  if (cascade_mode && !cascade_.empty()) {
+    return cascade_.tails()[cascade_tails_index_];
+  }
+  return tails_assay;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double Enrichment::SwuRequired_(double qty,
+                                const cyclus::toolkit::Assays& assays) {
+  if (cascade_mode && !cascade_.empty()) {
+    return qty * cascade_.SwuPerKg(assays.Product(), cascade_tails_index_);
+  }
+  return cyclus::toolkit::SwuRequired(qty, assays);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::BuildCascade_(double feed_assay) {
+  cascade_.Build(feed_assay, cascade_tails_min, cascade_tails_max,
+                 cascade_ntails);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool Enrichment::ChooseCascadeTails_(
+    const std::vector<double>& product_assays,
+    const std::vector<double>& product_qtys) {
+  double feed_assay = FeedAssay();
+  if (cascade_.empty()) {
+    BuildCascade_(feed_assay);
+  } else if (feed_assay != cascade_.feed()) {
+    cascade_.SetFeed(feed_assay);
+  }
+
+  // product value functions do not depend on the tails assay
+  std::vector<double> vproducts(product_assays.size());
+  for (int i = 0; i < product_assays.size(); i++) {
+    vproducts[i] = CascadeTable::Value(product_assays[i]);
+  }
+
+  // the share of all requests that can be filled at each candidate tails
+  // assay is limited by feed or SWU; ascending order keeps the lowest
+  // (feed-saving) tails assay among equally good candidates
+  double natu_frac = (feed_u235 + feed_u238) / inventory.quantity();
+  const std::vector<double>& tails = cascade_.tails();
+  double best = -1;
+  for (int k = 0; k < tails.size() && tails[k] < feed_assay; k++) {
+    double feed = 0;
+    double swu = 0;
+    for (int i = 0; i < product_assays.size(); i++) {
+      feed += product_qtys[i] * cascade_.FeedPerKg(product_assays[i], k);
+      swu += product_qtys[i] *
+             cascade_.SwuPerKg(product_assays[i], vproducts[i], k);
+    }
+    feed /= natu_frac;
+
+    double frac = 1;
+    if (feed > 0) {
+      frac = std::min(frac, inventory.quantity() / feed);
+    }
+    if (swu > 0) {
+      frac = std::min(frac, current_swu_capacity / swu);
+    }
+    if (frac > best + cyclus::eps()) {
+      best = frac;
+      cascade_tails_index_ = k;
+    }
+  }
+
+  if (best < 0) {
+    return false;
+  }
+  LOG(cyclus::LEV_INFO5, "EnrFac") << prototype()
+                                   << " chose a cascade tails assay of "
+                                   << TailsAssay_();
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::TrackFeed_(cyclus::Material::Ptr mat, double sign) {
+  if (inventory.empty()) {
+    // reset rather than accumulate round-off once the feed is used up
+    feed_u235 = 0;
+    feed_u238 = 0;
+    return;
+  }
+  cyclus::toolkit::MatQuery mq(mat);
+  feed_u235 += sign * mq.mass(922350000);
+  feed_u238 += sign * mq.mass(922380000);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
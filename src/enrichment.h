@@ -1,21 +1,97 @@
 #ifndef CYCAMORE_SRC_ENRICHMENT_H_
 #define CYCAMORE_SRC_ENRICHMENT_H_
 
+#include <map>
 #include <string>
+#include <vector>
 
 #include "cyclus.h"
 #include "cycamore_version.h"
 
 namespace cycamore {
 
+/// SwuFeedBatch computes the SWU and feed quantities required to produce each
+/// of a batch of product lots with the given (atom) U235 assays and
+/// quantities, for a single feed and tails assay. The results match
+/// cyclus::toolkit::SwuRequired and cyclus::toolkit::FeedQty, but the feed
+/// and tails value functions are evaluated once per batch rather than once
+/// per lot. It is only used for batched enrichment (batch_enrich); bids use
+/// the memoized SWUConverter and NatUConverter. All assays must lie strictly
+/// between zero and one.
+/// @throws cyclus::ValueError if product_assays and product_qtys differ in
+/// size
+void SwuFeedBatch(double feed_assay, double tails_assay,
+                  const std::vector<double>& product_assays,
+                  const std::vector<double>& product_qtys,
+                  std::vector<double>* swu, std::vector<double>* feed);
+
+/// @class CascadeTable
+///
+/// @brief The CascadeTable holds the ideal cascade value function at one feed
+/// assay and at a grid of candidate tails assays, so that picking a tails
+/// assay for a time step does not re-evaluate them for every candidate and
+/// request. The product value function is always evaluated exactly.
+class CascadeTable {
+ public:
+  CascadeTable() : feed_(0), vfeed_(0) {}
+
+  /// @brief (re)builds the table
+  /// @param feed the feed assay
+  /// @param tails_min the lowest candidate tails assay
+  /// @param tails_max the highest candidate tails assay
+  /// @param n_tails the number of candidate tails assays
+  void Build(double feed, double tails_min, double tails_max, int n_tails);
+
+  /// @brief moves the table to a new feed assay, keeping the tails grid
+  void SetFeed(double feed);
+
+  /// @return true if the table has not been built
+  inline bool empty() const { return tails_.empty(); }
+
+  /// @return the feed assay the table is for
+  inline double feed() const { return feed_; }
+
+  /// @return the candidate tails assays, in ascending order
+  inline const std::vector<double>& tails() const { return tails_; }
+
+  /// @return the ideal cascade value function V(x) = (2x - 1) ln(x / (1 - x))
+  static double Value(double assay);
+
+  /// @return the SWU required per kg of product at the given product assay
+  /// and candidate tails assay
+  inline double SwuPerKg(double product, int tails_index) const {
+    return SwuPerKg(product, Value(product), tails_index);
+  }
+
+  /// @return the SWU required per kg of product, given the product's value
+  /// function so that it can be reused across candidate tails assays
+  double SwuPerKg(double product, double vproduct, int tails_index) const;
+
+  /// @return the feed required per kg of product at the given product assay
+  /// and candidate tails assay
+  double FeedPerKg(double product, int tails_index) const;
+
+ private:
+  double feed_, vfeed_;
+  std::vector<double> tails_, vtails_;
+};
+
+
 /// @class SWUConverter
 ///
 /// @brief The SWUConverter is a simple Converter class for material to
-/// determine the amount of SWU required for their proposed enrichment
+/// determine the amount of SWU required for their proposed enrichment.
+/// SWU is linear in the product quantity, so the SWU per kg is memoized by
+/// composition id for the lifetime of the converter (i.e. one exchange).
 class SWUConverter : public cyclus::Converter<cyclus::Material> {
  public:
   SWUConverter(double feed_commod, double tails) : feed_(feed_commod),
-    tails_(tails) {}
+    tails_(tails), table_(NULL), tails_index_(0) {}
+
+  /// @brief converts using a cascade table at one of its tails assays
+  SWUConverter(const CascadeTable* table, int tails_index)
+    : feed_(table->feed()), tails_(table->tails()[tails_index]),
+      table_(table), tails_index_(tails_index) {}
   virtual ~SWUConverter() {}
 
   /// @brief provides a conversion for the SWU required
@@ -24,9 +100,20 @@ class SWUConverter : public cyclus::Converter<cyclus::Material> {
       cyclus::Arc const * a = NULL,
       cyclus::ExchangeTranslationContext<cyclus::Material>
           const * ctx = NULL) const {
-    cyclus::toolkit::Assays assays(feed_, cyclus::toolkit::UraniumAssay(m),
-                                   tails_);
-    return cyclus::toolkit::SwuRequired(m->quantity(), assays);
+    int id = m->comp()->id();
+    std::map<int, double>::iterator it = swu_per_kg_.find(id);
+    if (it == swu_per_kg_.end()) {
+      double swu;
+      if (table_ != NULL) {
+        swu = table_->SwuPerKg(cyclus::toolkit::UraniumAssay(m), tails_index_);
+      } else {
+        cyclus::toolkit::Assays assays(
+            feed_, cyclus::toolkit::UraniumAssay(m), tails_);
+        swu = cyclus::toolkit::SwuRequired(1.0, assays);
+      }
+      it = swu_per_kg_.insert(std::make_pair(id, swu)).first;
+    }
+    return m->quantity() * it->second;
   }
 
   /// @returns true if Converter is a SWUConverter and feed and tails equal
@@ -39,13 +126,17 @@ class SWUConverter : public cyclus::Converter<cyclus::Material> {
 
  private:
   double feed_, tails_;
+  const CascadeTable* table_;
+  int tails_index_;
+  mutable std::map<int, double> swu_per_kg_;
 };
 
 /// @class NatUConverter
 ///
 /// @brief The NatUConverter is a simple Converter class for material to
 /// determine the amount of natural uranium required for their proposed
-/// enrichment
+/// enrichment. Like the SWUConverter, the requirement per kg of product is
+/// memoized by composition id.
 class NatUConverter : public cyclus::Converter<cyclus::Material> {
  public:
   NatUConverter(double feed_commod, double tails) : feed_(feed_commod),
@@ -60,16 +151,21 @@ class NatUConverter : public cyclus::Converter<cyclus::Material> {
       cyclus::Arc const * a = NULL,
       cyclus::ExchangeTranslationContext<cyclus::Material>
           const * ctx = NULL) const {
-    cyclus::toolkit::Assays assays(feed_, cyclus::toolkit::UraniumAssay(m),
-                                   tails_);
-    cyclus::toolkit::MatQuery mq(m);
-    std::set<cyclus::Nuc> nucs;
-    nucs.insert(922350000);
-    nucs.insert(922380000);
-
-    double natu_frac = mq.mass_frac(nucs);
-    double natu_req = cyclus::toolkit::FeedQty(m->quantity(), assays);
-    return natu_req / natu_frac;
+    int id = m->comp()->id();
+    std::map<int, double>::iterator it = natu_per_kg_.find(id);
+    if (it == natu_per_kg_.end()) {
+      cyclus::toolkit::Assays assays(feed_, cyclus::toolkit::UraniumAssay(m),
+                                     tails_);
+      cyclus::toolkit::MatQuery mq(m);
+      std::set<cyclus::Nuc> nucs;
+      nucs.insert(922350000);
+      nucs.insert(922380000);
+
+      double natu_frac = mq.mass_frac(nucs);
+      double natu_req = cyclus::toolkit::FeedQty(1.0, assays);
+      it = natu_per_kg_.insert(std::make_pair(id, natu_req / natu_frac)).first;
+    }
+    return m->quantity() * it->second;
   }
 
   /// @returns true if Converter is a NatUConverter and feed and tails equal
@@ -82,6 +178,36 @@ class NatUConverter : public cyclus::Converter<cyclus::Material> {
 
  private:
   double feed_, tails_;
+  mutable std::map<int, double> natu_per_kg_;
+};
+
+/// @class TailsBinConverter
+///
+/// @brief The TailsBinConverter counts only the quantity of one binned tails
+/// offer, so that a capacity constraint using it limits what all tails
+/// requests together can take from that assay bin.
+class TailsBinConverter : public cyclus::Converter<cyclus::Material> {
+ public:
+  explicit TailsBinConverter(cyclus::Material::Ptr offer) : offer_(offer) {}
+  virtual ~TailsBinConverter() {}
+
+  /// @brief the offer quantity for the bin's offer, 0 for any other
+  virtual double convert(
+      cyclus::Material::Ptr m,
+      cyclus::Arc const * a = NULL,
+      cyclus::ExchangeTranslationContext<cyclus::Material>
+          const * ctx = NULL) const {
+    return m == offer_ ? m->quantity() : 0;
+  }
+
+  /// @returns true if Converter is a TailsBinConverter for the same offer
+  virtual bool operator==(Converter& other) const {
+    TailsBinConverter* cast = dynamic_cast<TailsBinConverter*>(&other);
+    return cast != NULL && offer_ == cast->offer_;
+  }
+
+ private:
+  cyclus::Material::Ptr offer_;
 };
 
 ///  The Enrichment facility is a simple Agent that enriches natural
@@ -114,6 +240,13 @@ class NatUConverter : public cyclus::Converter<cyclus::Material> {
 ///  The Enrichment facility also offers its tails as an output commodity with
 ///  no associated recipe.  Bids for tails are constrained only by total
 ///  tails inventory.
+///
+///  In cascade mode the tails assay is not fixed.  Each time step the
+///  facility picks, from a grid of candidate tails assays, the one that lets
+///  it fill the largest share of its product requests given its feed
+///  inventory and SWU capacity, preferring the lowest (feed-saving) tails
+///  among equals.  The tails value functions come from a CascadeTable built
+///  when the facility enters the simulation.
 
 class Enrichment : public cyclus::Facility {
 #pragma cyclus note {   	  \
@@ -169,6 +302,9 @@ class Enrichment : public cyclus::Facility {
   // --- Facility Members ---
   /// perform module-specific tasks when entering the simulation
   virtual void Build(cyclus::Agent* parent);
+
+  /// builds the cascade table when in cascade mode
+  virtual void EnterNotify();
   // ---
 
   // --- Agent Members ---
@@ -252,18 +388,77 @@ class Enrichment : public cyclus::Facility {
   ///  @brief Generates a material offer for a given request. The response
   ///  composition will be comprised only of U235 and U238 at their relative
   ///  ratio in the requested material. The response quantity will be the
-  ///  same as the requested commodity.
+  ///  same as the requested commodity. Offers at the same enrichment level
+  ///  share a single composition for the whole simulation.
   ///
   ///  @param req the requested material being responded to
   cyclus::Material::Ptr Offer_(cyclus::Material::Ptr req);
 
   cyclus::Material::Ptr Enrich_(cyclus::Material::Ptr mat, double qty);
 
+  ///  @brief responds to all product trades of a time step at once. SWU and
+  ///  feed are accounted for every trade first, then the feed is popped once,
+  ///  each product is extracted from it and the remainder becomes a single
+  ///  tails lot.
+  ///
+  ///  @param trades the product trades to respond to
+  ///  @param responses a container to populate with responses to each trade
+  void EnrichBatch_(
+    const std::vector< cyclus::Trade<cyclus::Material> >& trades,
+    std::vector<std::pair<cyclus::Trade<cyclus::Material>,
+    cyclus::Material::Ptr> >& responses);
+
   ///  @brief calculates the feed assay based on the unenriched inventory
   double FeedAssay();
 
-  ///  @brief records and enrichment with the cyclus::Recorder
-  void RecordEnrichment_(double natural_u, double swu);
+  ///  @brief the tails assay in effect: tails_assay, or the tails assay
+  ///  chosen for this time step in cascade mode
+  double TailsAssay_() const;
+
+  ///  @brief SWU required to produce a quantity of product at the given
+  ///  assays, from the cascade table in cascade mode
+  double SwuRequired_(double qty, const cyclus::toolkit::Assays& assays);
+
+  ///  @brief builds the cascade table for the given feed assay
+  void BuildCascade_(double feed_assay);
+
+  ///  @brief picks this time step's cascade tails assay for the given product
+  ///  assays and quantities, moving the cascade table to the current feed
+  ///  assay first
+  ///  @return false if no candidate tails assay is below the feed assay
+  bool ChooseCascadeTails_(const std::vector<double>& product_assays,
+                           const std::vector<double>& product_qtys);
+
+  ///  @brief returns the index of the tails_assay_bins bin that a material's
+  ///  uranium assay falls in
+  int TailsBin_(cyclus::Material::Ptr mat);
+
+  ///  @brief aggregates tails lots into one untracked offer per assay bin
+  ///  @param mats the tails lots to aggregate
+  ///  @param bins set to the bin index of each returned offer
+  cyclus::toolkit::MatVec BinTails_(const cyclus::toolkit::MatVec& mats,
+                                    std::vector<int>* bins);
+
+  ///  @brief pops a quantity of tails from the lots in one assay bin, oldest
+  ///  first. Any shortfall (i.e. from exchange rounding) is taken from the
+  ///  front of the tails inventory.
+  cyclus::Material::Ptr PopTailsBin_(double qty, int bin);
+
+  ///  @brief merges the tails inventory into one lot per assay bin
+  void ConsolidateTails_();
+
+  ///  @brief updates the running U-235/U-238 feed masses for a material
+  ///  entering (sign = 1) or leaving (sign = -1) the feed inventory
+  void TrackFeed_(cyclus::Material::Ptr mat, double sign);
+
+  ///  @brief records and enrichment with the cyclus::Recorder. In aggregated
+  ///  mode the enrichment is added to the time step totals instead, and the
+  ///  per-trade row is only written at debug log levels.
+  void RecordEnrichment_(double natural_u, double swu, double product_qty,
+                         double product_assay);
+
+  ///  @brief records the time step totals of all enrichments performed
+  void RecordAggregateEnrichments_();
   
   #pragma cyclus var { \
     "tooltip": "feed commodity",					\
@@ -346,6 +541,92 @@ class Enrichment : public cyclus::Facility {
   }
   bool order_prefs;
 
+  #pragma cyclus var {							\
+    "default": [],							\
+    "userlevel": 10,							\
+    "tooltip": "tails assay bin edges",					\
+    "uilabel": "Tails Assay Bins",					\
+    "doc": "ascending U235 assay edges used to group tails lots. If "	\
+           "given, tails are offered as one aggregated lot per assay bin " \
+           "rather than one bid per stored tails lot" \
+  }
+  std::vector<double> tails_assay_bins;
+
+  #pragma cyclus var {							\
+    "default": 0,							\
+    "userlevel": 10,							\
+    "tooltip": "consolidate tails lots by assay bin",			\
+    "uilabel": "Consolidate Tails",					\
+    "doc": "if true, the tails inventory is merged into one lot per "	\
+           "tails_assay_bins bin (or a single lot if no bins are given) " \
+           "at the end of every time step"				\
+  }
+  bool consolidate_tails;
+
+  #pragma cyclus var {							\
+    "default": 0,							\
+    "userlevel": 10,							\
+    "tooltip": "enrich all product trades of a time step in one batch", \
+    "uilabel": "Batch Enrichment",					\
+    "doc": "if true, all product trades of a time step are accounted at " \
+           "the feed assay of the start of trading and filled from a "	\
+           "single feed withdrawal, producing one tails lot per time step " \
+           "instead of one per trade"					\
+  }
+  bool batch_enrich;
+
+  #pragma cyclus var {							\
+    "default": 0,							\
+    "userlevel": 10,							\
+    "tooltip": "record enrichments once per time step",		\
+    "uilabel": "Aggregate Enrichment Records",				\
+    "doc": "if true, enrichments are recorded as one row per time step " \
+           "in the AggregateEnrichments table (totals, count and min/max " \
+           "product assay) rather than one Enrichments row per trade. "	\
+           "Per-trade rows are still written when logging at debug level" \
+  }
+  bool aggregate_enrichments;
+
+  #pragma cyclus var {							\
+    "default": 0,							\
+    "userlevel": 10,							\
+    "tooltip": "use a cascade table with a variable tails assay",	\
+    "uilabel": "Cascade Mode",						\
+    "doc": "if true, tails_assay is ignored and each time step the tails " \
+           "assay is chosen from cascade_ntails candidates between "	\
+           "cascade_tails_min and cascade_tails_max, so as to fill the "	\
+           "most product given the feed inventory and SWU capacity"	\
+  }
+  bool cascade_mode;
+
+  #pragma cyclus var {							\
+    "default": 0.001,							\
+    "userlevel": 10,							\
+    "tooltip": "lowest cascade tails assay",				\
+    "uilabel": "Cascade Minimum Tails Assay",				\
+    "doc": "lowest candidate tails assay in cascade mode"		\
+  }
+  double cascade_tails_min;
+
+  #pragma cyclus var {							\
+    "default": 0.004,							\
+    "userlevel": 10,							\
+    "tooltip": "highest cascade tails assay",				\
+    "uilabel": "Cascade Maximum Tails Assay",				\
+    "doc": "highest candidate tails assay in cascade mode. Must be less " \
+           "than the feed assay"						\
+  }
+  double cascade_tails_max;
+
+  #pragma cyclus var {							\
+    "default": 31,							\
+    "userlevel": 10,							\
+    "tooltip": "number of cascade tails assays",			\
+    "uilabel": "Cascade Tails Assay Count",				\
+    "doc": "number of evenly spaced candidate tails assays in cascade mode" \
+  }
+  int cascade_ntails;
+
   #pragma cyclus var {						       \
     "default": 1e299,						       \
     "tooltip": "SWU capacity (kgSWU/month)",			       \
@@ -362,10 +643,35 @@ class Enrichment : public cyclus::Facility {
   #pragma cyclus var {}
   cyclus::toolkit::ResBuf<cyclus::Material> tails;  // depleted u
 
+  // running U-235 and U-238 masses held in the feed inventory, so that the
+  // feed assay can be read without squashing the inventory
+  #pragma cyclus var {"default": 0, "internal": True}
+  double feed_u235;
+  #pragma cyclus var {"default": 0, "internal": True}
+  double feed_u238;
+
   // used to total intra-timestep swu and natu usage for meeting requests -
   // these help enable time series generation.
   double intra_timestep_swu_;
   double intra_timestep_feed_;
+
+  // per time step totals for aggregated enrichment records
+  int agg_count_;
+  double agg_natu_;
+  double agg_swu_;
+  double agg_product_;
+  double agg_min_assay_;
+  double agg_max_assay_;
+
+  // assay bin of each binned tails offer made this time step
+  std::map<cyclus::Material*, int> tails_offer_bins_;
+
+  // product compositions offered so far, keyed by U235 atom assay
+  std::map<double, cyclus::Composition::Ptr> product_comps_;
+
+  // cascade mode operating table and the tails assay chosen for this step
+  CascadeTable cascade_;
+  int cascade_tails_index_;
   
   friend class EnrichmentTest;
   // ---
@@ -314,6 +314,294 @@ TEST_F(EnrichmentTest, TradeTails) {
     "Not providing the requested quantity" ;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, TailsBins) {
+  // this tests that tails lots falling in the same assay bin are offered as
+  // a single aggregated lot and traded at the full binned quantity
+
+  std::string config = 
+    "   <feed_commod>natu</feed_commod> "
+    "   <feed_recipe>natu1</feed_recipe> "
+    "   <product_commod>enr_u</product_commod> "
+    "   <tails_commod>tails</tails_commod> "
+    "   <tails_assay>0.003</tails_assay> "
+    "   <tails_assay_bins><val>0.01</val></tails_assay_bins> ";
+
+  // time 1-source to EF, 2-Enrich, add to tails, 3-tails avail. for trade
+  int simdur = 3;
+  cyclus::MockSim sim(cyclus::AgentSpec
+		      (":cycamore:Enrichment"), config, simdur);
+  sim.AddRecipe("natu1", c_natu1());
+  sim.AddRecipe("leu", c_leu());
+  
+  sim.AddSource("natu")
+    .recipe("natu1")
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(0.5)
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(0.5)
+    .Finalize();
+  sim.AddSink("tails")
+    .Finalize();
+
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("tails")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+
+  // both tails lots share a bin, so there is one trade for their total
+  EXPECT_EQ(1, qr.rows.size());
+  Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+  EXPECT_NEAR(8.168, m->quantity(), 0.01) <<
+    "Not providing the binned tails quantity";
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, TailsBinTrade) {
+  // this tests that a binned tails trade is filled from the lots in the
+  // accepted bin rather than from the front of the tails inventory, and that
+  // each bin is capped at its own quantity
+  using cyclus::BidPortfolio;
+  using cyclus::Request;
+  using cyclus::Trade;
+  using cyclus::toolkit::UraniumAssay;
+
+  std::vector<double> edges;
+  edges.push_back(0.0025);
+  SetTailsBins(edges);
+
+  CompMap hi;
+  hi[922350000] = 0.003;
+  hi[922380000] = 0.997;
+  CompMap lo;
+  lo[922350000] = 0.002;
+  lo[922380000] = 0.998;
+  DoAddTails(Material::CreateUntracked(10, Composition::CreateFromAtom(hi)));
+  DoAddTails(Material::CreateUntracked(10, Composition::CreateFromAtom(lo)));
+
+  Request<Material>* req = Request<Material>::Create(
+      Material::CreateUntracked(20, c_nou235()), trader, tails_commod);
+  cyclus::CommodMap<Material>::type out_requests;
+  out_requests[tails_commod].push_back(req);
+
+  std::set<BidPortfolio<Material>::Ptr> ports =
+      src_facility->GetMatlBids(out_requests);
+  ASSERT_EQ(1, ports.size());
+  BidPortfolio<Material>::Ptr port = *ports.begin();
+  // the overall tails constraint plus one per bin
+  EXPECT_EQ(3, port->constraints().size());
+  ASSERT_EQ(2, port->bids().size());
+
+  cyclus::Bid<Material>* lo_bid = NULL;
+  std::set<cyclus::Bid<Material>*>::const_iterator it;
+  for (it = port->bids().begin(); it != port->bids().end(); ++it) {
+    if (UraniumAssay((*it)->offer()) < 0.0025) {
+      lo_bid = *it;
+    }
+  }
+  ASSERT_TRUE(lo_bid != NULL);
+
+  std::vector<Trade<Material> > trades;
+  trades.push_back(Trade<Material>(req, lo_bid, 4));
+  std::vector<std::pair<Trade<Material>, Material::Ptr> > responses;
+  src_facility->GetMatlTrades(trades, responses);
+
+  ASSERT_EQ(1, responses.size());
+  Material::Ptr m = responses[0].second;
+  EXPECT_NEAR(4, m->quantity(), 1e-9);
+  EXPECT_NEAR(0.002, UraniumAssay(m), 1e-9);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, ConsolidateTails) {
+  // this tests that tails lots are merged at the end of the time step and
+  // that the merged lot holds the full tails quantity
+
+  std::string config = 
+    "   <feed_commod>natu</feed_commod> "
+    "   <feed_recipe>natu1</feed_recipe> "
+    "   <product_commod>enr_u</product_commod> "
+    "   <tails_commod>tails</tails_commod> "
+    "   <tails_assay>0.003</tails_assay> "
+    "   <consolidate_tails>1</consolidate_tails> ";
+
+  // time 1-source to EF, 2-Enrich, add to tails, 3-tails avail. for trade
+  int simdur = 3;
+  cyclus::MockSim sim(cyclus::AgentSpec
+		      (":cycamore:Enrichment"), config, simdur);
+  sim.AddRecipe("natu1", c_natu1());
+  sim.AddRecipe("leu", c_leu());
+  
+  sim.AddSource("natu")
+    .recipe("natu1")
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(0.5)
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(0.5)
+    .Finalize();
+  sim.AddSink("tails")
+    .Finalize();
+
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("tails")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+
+  // the two tails lots were merged, so there is a single tails trade
+  EXPECT_EQ(1, qr.rows.size());
+  Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+  EXPECT_NEAR(8.168, m->quantity(), 0.01) <<
+    "Not providing the consolidated tails quantity";
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, BatchEnrich) {
+  // this tests that batched enrichment fills every product order and leaves
+  // the same total tails as per-trade enrichment, in a single lot
+
+  std::string config = 
+    "   <feed_commod>natu</feed_commod> "
+    "   <feed_recipe>natu1</feed_recipe> "
+    "   <product_commod>enr_u</product_commod> "
+    "   <tails_commod>tails</tails_commod> "
+    "   <tails_assay>0.003</tails_assay> "
+    "   <batch_enrich>1</batch_enrich> ";
+
+  // time 1-source to EF, 2-Enrich, add to tails, 3-tails avail. for trade
+  int simdur = 3;
+  cyclus::MockSim sim(cyclus::AgentSpec
+		      (":cycamore:Enrichment"), config, simdur);
+  sim.AddRecipe("natu1", c_natu1());
+  sim.AddRecipe("leu", c_leu());
+  
+  sim.AddSource("natu")
+    .recipe("natu1")
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(0.5)
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(0.5)
+    .Finalize();
+  sim.AddSink("tails")
+    .Finalize();
+
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("enr_u")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  // two product orders in each of time steps 2 and 3
+  EXPECT_EQ(4, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_NEAR(0.5, m->quantity(), 1e-10);
+    EXPECT_NEAR(0.04, MatQuery(m).mass_frac(922350000), 1e-10);
+  }
+
+  conds.clear();
+  conds.push_back(Cond("Commodity", "==", std::string("tails")));
+  qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ(1, qr.rows.size());
+  Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+  EXPECT_NEAR(8.168, m->quantity(), 0.01) <<
+    "Not providing the batched tails quantity";
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, AggregateEnrichments) {
+  // this tests that aggregated mode writes one row per time step with the
+  // totals of all trades instead of one row per trade
+
+  std::string config = 
+    "   <feed_commod>natu</feed_commod> "
+    "   <feed_recipe>natu1</feed_recipe> "
+    "   <product_commod>enr_u</product_commod> "
+    "   <tails_commod>tails</tails_commod> "
+    "   <tails_assay>0.003</tails_assay> "
+    "   <initial_feed>1000</initial_feed> "
+    "   <aggregate_enrichments>1</aggregate_enrichments> ";
+
+  int simdur = 1;
+  cyclus::MockSim sim(cyclus::AgentSpec
+		      (":cycamore:Enrichment"), config, simdur);
+  sim.AddRecipe("natu1", c_natu1());
+  sim.AddRecipe("leu", c_leu());
+  sim.AddRecipe("heu", c_heu());
+
+  sim.AddSink("enr_u")
+    .recipe("leu")
+    .capacity(1)
+    .Finalize();
+  sim.AddSink("enr_u")
+    .recipe("heu")
+    .capacity(1)
+    .Finalize();
+
+  int id = sim.Run();
+
+  QueryResult qr = sim.db().Query("AggregateEnrichments", NULL);
+  EXPECT_EQ(1, qr.rows.size());
+  EXPECT_EQ(2, qr.GetVal<int>("Count"));
+  EXPECT_NEAR(2.0, qr.GetVal<double>("Product"), 1e-10);
+  EXPECT_LT(qr.GetVal<double>("Min_Product_Assay"), 0.05);
+  EXPECT_GT(qr.GetVal<double>("Max_Product_Assay"), 0.19);
+
+  EXPECT_THROW(sim.db().Query("Enrichments", NULL), std::exception);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, CascadeSWUConstraint) {
+  // Tests that in cascade mode a SWU-limited facility with plenty of feed
+  // raises its tails assay and so fills more than the CheckSWUConstraint
+  // quantity (5kg at 0.003 tails) from the same SWU capacity
+
+  std::string config = 
+    "   <feed_commod>natu</feed_commod> "
+    "   <feed_recipe>natu1</feed_recipe> "
+    "   <product_commod>enr_u</product_commod> "
+    "   <tails_commod>tails</tails_commod> "
+    "   <initial_feed>1000</initial_feed> "
+    "   <swu_capacity>195</swu_capacity> "
+    "   <cascade_mode>1</cascade_mode> "
+    "   <cascade_tails_min>0.002</cascade_tails_min> "
+    "   <cascade_tails_max>0.004</cascade_tails_max> ";
+
+  int simdur = 1;
+  cyclus::MockSim sim(cyclus::AgentSpec
+		      (":cycamore:Enrichment"), config, simdur);
+  sim.AddRecipe("natu1", c_natu1());
+  sim.AddRecipe("heu", c_heu());
+  
+  sim.AddSink("enr_u")
+    .recipe("heu")
+    .capacity(10)
+    .Finalize();
+  
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("enr_u")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+
+  EXPECT_EQ(1.0, qr.rows.size());
+  EXPECT_GT(m->quantity(), 5.5) << "cascade did not raise its tails assay";
+  EXPECT_LT(m->quantity(), 10) << "traded quantity exceeds SWU constraint";
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, BidPrefs) {
   // This tests that natu sources are preference-ordered by
@@ -500,6 +788,16 @@ void EnrichmentTest::DoAddMat(cyclus::Material::Ptr mat) {
   src_facility->AddMat_(mat);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void EnrichmentTest::DoAddTails(cyclus::Material::Ptr mat) {
+  src_facility->tails.Push(mat);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void EnrichmentTest::SetTailsBins(const std::vector<double>& edges) {
+  src_facility->tails_assay_bins = edges;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 cyclus::Material::Ptr EnrichmentTest::DoRequest() {
   return src_facility->Request_();
@@ -517,6 +815,19 @@ EnrichmentTest::DoEnrich(cyclus::Material::Ptr mat, double qty) {
   return src_facility->Enrich_(mat, qty);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double EnrichmentTest::DoFeedAssay() {
+  return src_facility->FeedAssay();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double EnrichmentTest::InventoryAssay() {
+  cyclus::Material::Ptr m = cyclus::toolkit::Squash(
+      src_facility->inventory.PopN(src_facility->inventory.count()));
+  src_facility->inventory.Push(m);
+  return cyclus::toolkit::UraniumAssay(m);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, Request) {
   // Tests that quantity in material request is accurate
@@ -610,6 +921,133 @@ TEST_F(EnrichmentTest, ValidReq) {
   EXPECT_NEAR(natuc.convert(target) * mass_frac, natuc.convert(offer), 0.001); 
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, ConverterMemo) {
+  // Tests that memoized converters scale with quantity for a repeated
+  // composition and agree with the direct SWU and feed calculations
+  using cyclus::CompMap;
+  using cyclus::Composition;
+  using cyclus::Material;
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+  using cyclus::toolkit::SwuRequired;
+  using cyclus::toolkit::UraniumAssay;
+
+  CompMap v;
+  v[922350000] = 0.04;
+  v[922380000] = 0.96;
+  Composition::Ptr c = Composition::CreateFromMass(v);
+
+  SWUConverter swuc(feed_assay, tails_assay);
+  NatUConverter natuc(feed_assay, tails_assay);
+
+  double qtys[] = {1, 7.5, 0.25};
+  for (int i = 0; i < 3; i++) {
+    Material::Ptr m = Material::CreateUntracked(qtys[i], c);
+    Assays assays(feed_assay, UraniumAssay(m), tails_assay);
+    EXPECT_NEAR(SwuRequired(qtys[i], assays), swuc.convert(m), 1e-9);
+    EXPECT_NEAR(FeedQty(qtys[i], assays), natuc.convert(m), 1e-9);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, SwuFeedBatch) {
+  // Tests the batch SWU/feed kernel against the toolkit functions
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+  using cyclus::toolkit::SwuRequired;
+
+  std::vector<double> assays;
+  std::vector<double> qtys;
+  for (int i = 0; i < 37; i++) {
+    assays.push_back(0.0035 + i * 0.025);
+    qtys.push_back(0.5 + i);
+  }
+
+  std::vector<double> swu;
+  std::vector<double> feed;
+  SwuFeedBatch(feed_assay, tails_assay, assays, qtys, &swu, &feed);
+  ASSERT_EQ(assays.size(), swu.size());
+  ASSERT_EQ(assays.size(), feed.size());
+  for (int i = 0; i < assays.size(); i++) {
+    Assays a(feed_assay, assays[i], tails_assay);
+    double want_swu = SwuRequired(qtys[i], a);
+    double want_feed = FeedQty(qtys[i], a);
+    EXPECT_NEAR(want_swu, swu[i], 1e-10 * want_swu);
+    EXPECT_NEAR(want_feed, feed[i], 1e-10 * want_feed);
+  }
+
+  SwuFeedBatch(feed_assay, tails_assay, std::vector<double>(),
+               std::vector<double>(), &swu, &feed);
+  EXPECT_TRUE(swu.empty());
+  EXPECT_TRUE(feed.empty());
+
+  qtys.pop_back();
+  EXPECT_THROW(SwuFeedBatch(feed_assay, tails_assay, assays, qtys, &swu,
+                            &feed),
+               cyclus::ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, CascadeTable) {
+  // Tests cascade table SWU and feed against the toolkit functions, before
+  // and after moving the table to a new feed assay
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+  using cyclus::toolkit::SwuRequired;
+
+  CascadeTable table;
+  EXPECT_TRUE(table.empty());
+  table.Build(feed_assay, 0.001, 0.004, 4);
+  ASSERT_EQ(4, table.tails().size());
+  EXPECT_DOUBLE_EQ(0.001, table.tails()[0]);
+  EXPECT_DOUBLE_EQ(0.004, table.tails()[3]);
+
+  double feeds[] = {feed_assay, 0.0065};
+  double products[] = {0.0101, 0.0437, 0.2, 0.61, 0.95};
+  for (int f = 0; f < 2; f++) {
+    table.SetFeed(feeds[f]);
+    EXPECT_DOUBLE_EQ(feeds[f], table.feed());
+    for (int k = 0; k < table.tails().size(); k++) {
+      for (int i = 0; i < 5; i++) {
+        Assays a(feeds[f], products[i], table.tails()[k]);
+        double want_swu = SwuRequired(1, a);
+        EXPECT_NEAR(want_swu, table.SwuPerKg(products[i], k),
+                    1e-10 * want_swu);
+        EXPECT_NEAR(FeedQty(1, a), table.FeedPerKg(products[i], k), 1e-10);
+      }
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, OfferComp) {
+  // Tests that offers for the same enrichment level share one composition
+  using cyclus::CompMap;
+  using cyclus::Composition;
+  using cyclus::Material;
+
+  CompMap v;
+  v[922350000] = 0.04;
+  v[922380000] = 0.96;
+  Material::Ptr req1 =
+      Material::CreateUntracked(3, Composition::CreateFromMass(v));
+  Material::Ptr req2 =
+      Material::CreateUntracked(5, Composition::CreateFromMass(v));
+  v[922350000] = 0.05;
+  v[922380000] = 0.95;
+  Material::Ptr req3 =
+      Material::CreateUntracked(5, Composition::CreateFromMass(v));
+
+  Material::Ptr off1 = DoOffer(req1);
+  Material::Ptr off2 = DoOffer(req2);
+  Material::Ptr off3 = DoOffer(req3);
+  EXPECT_EQ(off1->comp(), off2->comp());
+  EXPECT_NE(off1->comp(), off3->comp());
+  EXPECT_DOUBLE_EQ(5, off2->quantity());
+  EXPECT_NEAR(0.04, MatQuery(off1).mass_frac(922350000), 1e-12);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, Enrich) {
   // this test asks the facility to enrich a material that results in an amount
@@ -659,6 +1097,35 @@ TEST_F(EnrichmentTest, Enrich) {
   EXPECT_THROW(response = DoEnrich(target, qty), cyclus::Error);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, FeedAssay) {
+  // Tests that the tracked feed assay follows the inventory as heterogeneous
+  // feed lots are added and consumed
+  using cyclus::CompMap;
+  using cyclus::Composition;
+  using cyclus::Material;
+
+  EXPECT_DOUBLE_EQ(0, DoFeedAssay());
+
+  src_facility->SetMaxInventorySize(100);
+  DoAddMat(GetMat(20));
+  EXPECT_NEAR(feed_assay, DoFeedAssay(), 1e-12);
+
+  CompMap v;
+  v[922350000] = 0.01;
+  v[922380000] = 0.99;
+  DoAddMat(Material::CreateUntracked(30, Composition::CreateFromAtom(v)));
+  EXPECT_NEAR(InventoryAssay(), DoFeedAssay(), 1e-12);
+
+  CompMap p;
+  p[922350000] = 0.05;
+  p[922380000] = 0.95;
+  Material::Ptr target =
+      Material::CreateUntracked(1, Composition::CreateFromMass(p));
+  DoEnrich(target, 1);
+  EXPECT_NEAR(InventoryAssay(), DoFeedAssay(), 1e-12);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, Response) {
   // this test asks the facility to respond to multiple requests for enriched
@@ -37,10 +37,15 @@ class EnrichmentTest : public ::testing::Test {
   /// @param enr the enrichment percent, i.e. for 5 w/o, enr = 0.05
   cyclus::Material::Ptr GetReqMat(double qty, double enr);
   void DoAddMat(cyclus::Material::Ptr mat);
+  void DoAddTails(cyclus::Material::Ptr mat);
+  void SetTailsBins(const std::vector<double>& edges);
   cyclus::Material::Ptr DoRequest();
   cyclus::Material::Ptr DoBid(cyclus::Material::Ptr mat);
   cyclus::Material::Ptr DoOffer(cyclus::Material::Ptr mat);
   cyclus::Material::Ptr DoEnrich(cyclus::Material::Ptr mat, double qty);
+  double DoFeedAssay();
+  /// @return the uranium assay of the squashed feed inventory
+  double InventoryAssay();
   /// @param nreqs the total number of requests
   /// @param nvalid the number of requests that are valid
   boost::shared_ptr< cyclus::ExchangeContext<cyclus::Material> >
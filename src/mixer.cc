@@ -3,6 +3,9 @@
 
 namespace cycamore {
 
+// blends to keep, one per combination of input stream compositions
+const int kMaxBlendCache = 32;
+
 Mixer::Mixer(cyclus::Context* ctx) : cyclus::Facility(ctx), throughput(0) {
   cyclus::Warn<cyclus::EXPERIMENTAL_WARNING>(
       "the Mixer archetype is experimental");
@@ -27,12 +30,13 @@ cyclus::Inventories Mixer::SnapshotInv() {
 }
 
 void Mixer::InitInv(cyclus::Inventories& inv) {
-  inv["output-inv-name"] = output.PopNRes(output.count());
   output.Push(inv["output-inv-name"]);
 
   cyclus::Inventories::iterator it;
   for (it = inv.begin(); it != inv.end(); ++it) {
-    streambufs[it->first].Push(it->second);
+    if (it->first != "output-inv-name") {
+      streambufs[it->first].Push(it->second);
+    }
   }
 }
 
@@ -84,40 +88,98 @@ void Mixer::EnterNotify() {
       streambufs[name].capacity(cap);
     }
   }
+  InitBufs_();
 
   sell_policy.Init(this, &output, "output").Set(out_commod).Start();
 }
 
+void Mixer::InitBufs_() {
+  if (inbufs_.size() == in_commods.size()) {
+    return;
+  }
+  inbufs_.clear();
+  for (int i = 0; i < in_commods.size(); i++) {
+    inbufs_.push_back(&streambufs[in_commods[i]]);
+  }
+}
+
 void Mixer::Tick() {
+  InitBufs_();
   if (output.quantity() < output.capacity()) {
     double tgt_qty = output.space();
 
-    for (int i = 0; i < in_commods.size(); i++) {
-      std::string name = in_commods[i];
-      tgt_qty =
-          std::min(tgt_qty, streambufs[name].quantity() / mixing_ratios[i]);
+    for (int i = 0; i < inbufs_.size(); i++) {
+      tgt_qty = std::min(tgt_qty, inbufs_[i]->quantity() / mixing_ratios[i]);
     }
 
     tgt_qty = std::min(tgt_qty, throughput);
 
-    if (tgt_qty > 0) {
-      cyclus::Material::Ptr m;
-      for (int i = 0; i < in_commods.size(); i++) {
-        std::string name = in_commods[i];
-        if (i == 0) {
-          m = streambufs[name].Pop(mixing_ratios[i] * tgt_qty);
-        } else {
-          cyclus::Material::Ptr m_ =
-              streambufs[name].Pop(mixing_ratios[i] * tgt_qty);
-          m->Absorb(m_);
-        }
+    if (tgt_qty > 0 && !inbufs_.empty()) {
+      std::vector<cyclus::Material::Ptr> mats(inbufs_.size());
+      for (int i = 0; i < inbufs_.size(); i++) {
+        mats[i] = inbufs_[i]->Pop(mixing_ratios[i] * tgt_qty);
+      }
+
+      // Absorb makes an intermediate composition for each input whose
+      // composition differs, and it is the only way to combine the inputs
+      // without rewriting their own records. The product is then set to
+      // the cached blend composition so that repeat blends share one id.
+      cyclus::Composition::Ptr c = BlendComp_(mats);
+      cyclus::Material::Ptr m = mats[0];
+      for (int i = 1; i < mats.size(); i++) {
+        m->Absorb(mats[i]);
       }
+      m->Transmute(c);
 
       output.Push(m);
     }
   }
 }
 
+cyclus::Composition::Ptr Mixer::BlendComp_(
+    const std::vector<cyclus::Material::Ptr>& mats) {
+  if (blend_ratios_ != mixing_ratios) {
+    blend_cache_.clear();
+    blend_ratios_ = mixing_ratios;
+  }
+
+  std::vector<int> key(mats.size());
+  for (int i = 0; i < mats.size(); i++) {
+    key[i] = mats[i]->comp()->id();
+  }
+  std::map<std::vector<int>, cyclus::Composition::Ptr>::iterator found =
+      blend_cache_.find(key);
+  if (found != blend_cache_.end()) {
+    return found->second;
+  }
+
+  if (blend_cache_.size() >= kMaxBlendCache) {
+    blend_cache_.clear();
+  }
+
+  // sum the nuclide masses of all inputs once
+  cyclus::CompMap blend;
+  for (int i = 0; i < mats.size(); i++) {
+    const cyclus::CompMap& v = mats[i]->comp()->mass();
+    double tot = 0;
+    cyclus::CompMap::const_iterator it;
+    for (it = v.begin(); it != v.end(); ++it) {
+      tot += it->second;
+    }
+    if (tot <= 0) {
+      continue;
+    }
+    double scale = mats[i]->quantity() / tot;
+    for (it = v.begin(); it != v.end(); ++it) {
+      blend[it->first] += it->second * scale;
+    }
+  }
+
+  cyclus::Composition::Ptr c = cyclus::Composition::CreateFromMass(blend);
+  blend_cache_[key] = c;
+  return c;
+}
+
 std::set<cyclus::RequestPortfolio<cyclus::Material>::Ptr>
 Mixer::GetMatlRequests() {
   using cyclus::RequestPortfolio;
@@ -121,6 +121,23 @@ class Mixer : public cyclus::Facility {
   }
   double throughput;
 
+  // input buffers in in_commods order, pointing into streambufs
+  std::vector<cyclus::toolkit::ResBuf<cyclus::Material>*> inbufs_;
+
+  /// (re)builds inbufs_ if it does not match in_commods
+  void InitBufs_();
+
+  /// returns the composition of the blend of mats (one per input stream,
+  /// popped in mixing_ratios proportions), reusing the previous result for
+  /// the same input compositions and ratios.
+  cyclus::Composition::Ptr BlendComp_(
+      const std::vector<cyclus::Material::Ptr>& mats);
+
+  // blend compositions keyed by the input composition ids, valid for the
+  // mixing ratios in blend_ratios_
+  std::map<std::vector<int>, cyclus::Composition::Ptr> blend_cache_;
+  std::vector<double> blend_ratios_;
+
   // intra-time-step state - no need to be a state var
   // map<request, inventory name>
   std::map<cyclus::Request<cyclus::Material>*, std::string> req_inventories_;
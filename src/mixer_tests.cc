@@ -237,6 +237,85 @@ TEST_F(MixerTest, MixingComposition) {
   }
 }
 
+// Mixing conserves the mass of each nuclide and produces a single material.
+TEST_F(MixerTest, MixingConservesNuclides) {
+  using cyclus::Material;
+  using pyne::nucname::id;
+
+  std::vector<double> in_frac_ = {0.80, 0.15, 0.05};
+  SetStream_ratio(in_frac_);
+  SetOutStream_capacity(50);
+  SetThroughput(10);
+
+  std::vector<Material::Ptr> mat;
+  mat.push_back(Material::CreateUntracked(in_cap[0], c_natu()));
+  mat.push_back(Material::CreateUntracked(in_cap[1], c_pustream()));
+  mat.push_back(Material::CreateUntracked(in_cap[2], c_uox()));
+  SetInputInv(mat);
+  mf_facility_->Tick();
+
+  InvBuffer* buffer = GetOutPutBuffer();
+  ASSERT_EQ(1, buffer->count());
+  Material::Ptr final_mat = cyclus::ResCast<Material>(buffer->PopBack());
+  EXPECT_DOUBLE_EQ(10, final_mat->quantity());
+
+  cyclus::toolkit::MatQuery mq(final_mat);
+  cyclus::toolkit::MatQuery natu(Material::CreateUntracked(1, c_natu()));
+  cyclus::toolkit::MatQuery pu(Material::CreateUntracked(1, c_pustream()));
+  cyclus::toolkit::MatQuery uox(Material::CreateUntracked(1, c_uox()));
+  EXPECT_NEAR(10 * (0.80 * natu.mass(id("u235")) + 0.05 * uox.mass(id("u235"))),
+              mq.mass(id("u235")), 1e-12);
+  EXPECT_NEAR(10 * 0.15 * pu.mass(id("pu239")), mq.mass(id("pu239")), 1e-12);
+}
+
+// Mixing does not rewrite the compositions of the inputs it absorbs.
+TEST_F(MixerTest, MixingKeepsInputComps) {
+  using cyclus::Material;
+
+  std::vector<double> in_frac_ = {0.80, 0.15, 0.05};
+  SetStream_ratio(in_frac_);
+  SetOutStream_capacity(50);
+  SetThroughput(10);
+
+  // each input lot is exactly the quantity drawn from its stream
+  std::vector<Material::Ptr> mat;
+  mat.push_back(Material::CreateUntracked(8, c_natu()));
+  mat.push_back(Material::CreateUntracked(1.5, c_pustream()));
+  mat.push_back(Material::CreateUntracked(0.5, c_uox()));
+  cyclus::Composition::Ptr pu = mat[1]->comp();
+  cyclus::Composition::Ptr uox = mat[2]->comp();
+  SetInputInv(mat);
+  mf_facility_->Tick();
+
+  ASSERT_EQ(1, GetOutPutBuffer()->count());
+  EXPECT_EQ(pu, mat[1]->comp());
+  EXPECT_EQ(uox, mat[2]->comp());
+}
+
+// Repeat blends of the same input compositions share one output composition.
+TEST_F(MixerTest, BlendCache) {
+  using cyclus::Material;
+
+  std::vector<double> in_frac_ = {0.80, 0.15, 0.05};
+  SetStream_ratio(in_frac_);
+  SetOutStream_capacity(50);
+  SetThroughput(10);
+
+  std::vector<Material::Ptr> mat;
+  mat.push_back(Material::CreateUntracked(in_cap[0], c_natu()));
+  mat.push_back(Material::CreateUntracked(in_cap[1], c_pustream()));
+  mat.push_back(Material::CreateUntracked(in_cap[2], c_uox()));
+  SetInputInv(mat);
+  mf_facility_->Tick();
+  mf_facility_->Tick();
+
+  InvBuffer* buffer = GetOutPutBuffer();
+  ASSERT_EQ(2, buffer->count());
+  cyclus::toolkit::MatVec out = buffer->PopN(2);
+  EXPECT_EQ(out[0]->comp(), out[1]->comp());
+  EXPECT_DOUBLE_EQ(10, out[1]->quantity());
+}
+
 // Check the throughput constrain
 TEST_F(MixerTest, Throughput) {
   using cyclus::Material;
@@ -283,6 +362,33 @@ TEST_F(MixerTest, Throughput) {
          "correctly constrained by throughput.";
 }
 
+// Inventories survive a SnapshotInv/InitInv round trip, with the output kept
+// out of the input streams.
+TEST_F(MixerTest, InventoryRoundTrip) {
+  using cyclus::Material;
+
+  std::vector<Material::Ptr> mat;
+  mat.push_back(Material::CreateUntracked(in_cap[0], c_natu()));
+  mat.push_back(Material::CreateUntracked(in_cap[1], c_pustream()));
+  mat.push_back(Material::CreateUntracked(in_cap[2], c_uox()));
+  SetInputInv(mat);
+  GetOutPutBuffer()->Push(Material::CreateUntracked(5, c_uox()));
+
+  cyclus::Inventories invs = mf_facility_->SnapshotInv();
+  EXPECT_EQ(5, GetOutPutBuffer()->quantity());
+
+  // restore into a fresh facility, which TearDown deletes
+  delete mf_facility_;
+  mf_facility_ = new Mixer(tc_.get());
+  mf_facility_->InitInv(invs);
+  EXPECT_DOUBLE_EQ(5, GetOutPutBuffer()->quantity());
+  std::map<std::string, InvBuffer> streambuf = GetStreamBuffer();
+  EXPECT_EQ(in_com.size(), streambuf.size());
+  for (int i = 0; i < in_com.size(); i++) {
+    EXPECT_DOUBLE_EQ(in_cap[i], streambuf[in_com[i]].quantity());
+  }
+}
+
 // multiple input streams can be correctly requested and used as
 //  material inventory.
 TEST(MixerTests, MultipleFissStreams) {
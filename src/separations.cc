@@ -1,5 +1,7 @@
 #include "separations.h"
 
+#include <thread>
+
 using cyclus::Material;
 using cyclus::Composition;
 using cyclus::toolkit::ResBuf;
@@ -11,7 +13,33 @@ using cyclus::CompMap;
 
 namespace cycamore {
 
-Separations::Separations(cyclus::Context* ctx) : cyclus::Facility(ctx) { }
+// Counts only material of one composition, so that a capacity constraint
+// using it limits what all requests together can take of that composition.
+class CompConverter : public cyclus::Converter<Material> {
+ public:
+  explicit CompConverter(Composition::Ptr c) : c_(c) {}
+  virtual ~CompConverter() {}
+
+  virtual double convert(Material::Ptr m, cyclus::Arc const* a = NULL,
+                         cyclus::ExchangeTranslationContext<Material> const*
+                             ctx = NULL) const {
+    return m->comp() == c_ ? m->quantity() : 0;
+  }
+
+  virtual bool operator==(Converter& other) const {
+    CompConverter* cast = dynamic_cast<CompConverter*>(&other);
+    return cast != NULL && c_ == cast->c_;
+  }
+
+ private:
+  Composition::Ptr c_;
+};
+
+Separations::Separations(cyclus::Context* ctx)
+    : cyclus::Facility(ctx),
+      process_lots(false),
+      aggregate_bids(false),
+      sep_threads(1) {}
 
 cyclus::Inventories Separations::SnapshotInv() {
   cyclus::Inventories invs;
@@ -39,13 +67,21 @@ void Separations::InitInv(cyclus::Inventories& inv) {
 
   cyclus::Inventories::iterator it;
   for (it = inv.begin(); it != inv.end(); ++it) {
-    streambufs[it->first].Push(it->second);
+    if (it->first != "leftover-inv-name" && it->first != "feed-inv-name") {
+      streambufs[it->first].Push(it->second);
+    }
   }
 }
 
 typedef std::pair<double, std::map<int, double> > Stream;
 typedef std::map<std::string, Stream> StreamSet;
 
+// number of feed compositions to remember separation results for.  Each entry
+// keeps one output composition per stream alive, and feed squashed from
+// several lots is a new composition that never recurs, so this only needs to
+// cover the distinct recipes of steady feed.
+const int kMaxSepCache = 32;
+
 void Separations::EnterNotify() {
   cyclus::Facility::EnterNotify();
   std::map<int, double> efficiency_;
@@ -55,15 +91,16 @@ void Separations::EnterNotify() {
 
 
   for (it = streams_.begin(); it != streams_.end(); ++it) {
-    std::string name = it->first;
-    Stream stream = it->second;
+    const std::string& name = it->first;
+    const Stream& stream = it->second;
     double cap = stream.first;
     if (cap >= 0) {
       streambufs[name].capacity(cap);
     }
     
-    for( it2 = stream.second.begin(); it2 != stream.second.end(); it2++  ){
-      efficiency_[it2->first] += it2->second;
+    for (std::map<int, double>::const_iterator eff = stream.second.begin();
+         eff != stream.second.end(); ++eff) {
+      efficiency_[eff->first] += eff->second;
     }
     
   }
@@ -91,6 +128,34 @@ void Separations::EnterNotify() {
     throw cyclus::ValueError(ss.str());
   }
 
+  // compile the streams so the per-step path indexes them directly, each
+  // with its efficiencies as a dense row over a nuclide index.  Nuclides
+  // named explicitly or present in the feed recipe are indexed up front; any
+  // others are indexed the first time they show up in the feed.
+  nucs_.clear();
+  nuc_index_.clear();
+  sepstreams_.clear();
+  for (it = streams_.begin(); it != streams_.end(); ++it) {
+    SepStream s;
+    s.commod = it->first;
+    s.buf = &streambufs[it->first];
+    s.effs = &it->second.second;
+    sepstreams_.push_back(s);
+  }
+  for (it = streams_.begin(); it != streams_.end(); ++it) {
+    std::map<int, double>& effs = it->second.second;
+    for (it2 = effs.begin(); it2 != effs.end(); ++it2) {
+      if (it2->first % 10000000 != 0) {
+        NucIndex_(it2->first);
+      }
+    }
+  }
+  if (!feed_recipe.empty()) {
+    const CompMap& cm = context()->GetRecipe(feed_recipe)->mass();
+    for (CompMap::const_iterator itc = cm.begin(); itc != cm.end(); ++itc) {
+      NucIndex_(itc->first);
+    }
+  }
 
   if (feed_commod_prefs.size() == 0) {
     for (int i = 0; i < feed_commods.size(); i++) {
@@ -99,55 +164,194 @@ void Separations::EnterNotify() {
   }
 }
 
+// adds m to mats, absorbing it into a material of the same composition if
+// there is one so that no new compositions are created.
+void AddByComp(MatVec* mats, Material::Ptr m) {
+  for (int i = 0; i < mats->size(); ++i) {
+    if ((*mats)[i]->comp() == m->comp()) {
+      (*mats)[i]->Absorb(m);
+      return;
+    }
+  }
+  mats->push_back(m);
+}
+
 void Separations::Tick() {
   if (feed.count() == 0) {
     return;
   }
 
-  Material::Ptr mat = feed.Pop(std::min(throughput, feed.quantity()));
-  double orig_qty = mat->quantity();
+  double qty = std::min(throughput, feed.quantity());
+  MatVec lots;
+  if (process_lots) {
+    lots = PopLots(&feed, qty);
+  } else {
+    lots.push_back(feed.Pop(qty));
+  }
+
+  SeparateLots_(lots);
+}
+
+void Separations::SeparateLots_(const MatVec& lots) {
+  // total quantity staged for each stream
+  int nstreams = sepstreams_.size();
+  std::vector<double> staged(nstreams, 0);
+  for (int k = 0; k < lots.size(); ++k) {
+    const std::vector<SepFrac>& seps = Separate_(lots[k]->comp());
+    for (int i = 0; i < seps.size(); ++i) {
+      staged[i] += seps[i].second * lots[k]->quantity();
+    }
+  }
 
-  StreamSet::iterator it;
   double maxfrac = 1;
-  std::map<std::string, Material::Ptr> stagedsep;
-  for (it = streams_.begin(); it != streams_.end(); ++it) {
-    Stream info = it->second;
-    std::string name = it->first;
-    stagedsep[name] = SepMaterial(info.second, mat);
-    double frac = streambufs[name].space() / stagedsep[name]->quantity();
+  for (int i = 0; i < nstreams; ++i) {
+    double frac = sepstreams_[i].buf->space() / staged[i];
     if (frac < maxfrac) {
       maxfrac = frac;
     }
   }
 
-  std::map<std::string, Material::Ptr>::iterator itf;
-  for (itf = stagedsep.begin(); itf != stagedsep.end(); ++itf) {
-    std::string name = itf->first;
-    Material::Ptr m = itf->second;
-    if (m->quantity() > 0) {
-      streambufs[name].Push(
-          mat->ExtractComp(m->quantity() * maxfrac, m->comp()));
+  std::vector<MatVec> outs(nstreams);
+  MatVec rest;
+  for (int k = 0; k < lots.size(); ++k) {
+    Material::Ptr mat = lots[k];
+    double orig_qty = mat->quantity();
+    const std::vector<SepFrac>& seps = Separate_(mat->comp());
+    for (int i = 0; i < nstreams; ++i) {
+      double q = seps[i].second * orig_qty;
+      if (q > 0) {
+        AddByComp(&outs[i], mat->ExtractComp(q * maxfrac, seps[i].first));
+      }
     }
-  }
 
-  if (maxfrac == 1) {
-    if (mat->quantity() > 0) {
-      // unspecified separations fractions go to leftovers
-      leftover.Push(mat);
+    if (maxfrac < 1) {
+      // push back any leftover feed due to separated stream inv size
+      // constraints
+      feed.Push(mat->ExtractQty((1 - maxfrac) * orig_qty));
     }
-  } else {  // maxfrac is < 1
-    // push back any leftover feed due to separated stream inv size constraints
-    feed.Push(mat->ExtractQty((1 - maxfrac) * orig_qty));
     if (mat->quantity() > 0) {
       // unspecified separations fractions go to leftovers
-      leftover.Push(mat);
+      AddByComp(&rest, mat);
+    }
+  }
+
+  for (int i = 0; i < nstreams; ++i) {
+    if (outs[i].size() > 0) {
+      sepstreams_[i].buf->Push(outs[i]);
+    }
+  }
+  if (rest.size() > 0) {
+    leftover.Push(rest);
+  }
+}
+
+int Separations::NucIndex_(int nuc) {
+  std::map<int, int>::iterator found = nuc_index_.find(nuc);
+  if (found != nuc_index_.end()) {
+    return found->second;
+  }
+
+  int i = nucs_.size();
+  nucs_.push_back(nuc);
+  nuc_index_[nuc] = i;
+  for (int j = 0; j < sepstreams_.size(); ++j) {
+    sepstreams_[j].row.push_back(SepEfficiency(*sepstreams_[j].effs, nuc));
+  }
+  return i;
+}
+
+const std::vector<Separations::SepFrac>& Separations::Separate_(
+    Composition::Ptr c) {
+  std::map<int, std::vector<SepFrac> >::iterator found =
+      sep_cache_.find(c->id());
+  if (found != sep_cache_.end()) {
+    return found->second;
+  }
+
+  if (sep_cache_.size() >= kMaxSepCache) {
+    sep_cache_.clear();
+  }
+
+  // separate one kg of feed so each result scales to any feed quantity
+  std::vector<double> masses;
+  FeedMasses_(c, 1, &masses);
+  int nstreams = sepstreams_.size();
+  std::vector<CompMap> sepcomps(nstreams);
+  std::vector<double> qtys(nstreams);
+  int nthreads = std::min(sep_threads, nstreams);
+  if (nthreads > 1) {
+    // thread t separates streams t, t + nthreads, ...  Each stream's result
+    // is computed the same way whichever thread runs it.
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nthreads; ++t) {
+      workers.push_back(std::thread([&, t]() {
+        for (int i = t; i < nstreams; i += nthreads) {
+          qtys[i] = SepDenseMasses(nucs_, sepstreams_[i].row, masses,
+                                   &sepcomps[i]);
+        }
+      }));
+    }
+    for (int t = 0; t < nthreads; ++t) {
+      workers[t].join();
     }
+  } else {
+    for (int i = 0; i < nstreams; ++i) {
+      qtys[i] = SepDenseMasses(nucs_, sepstreams_[i].row, masses,
+                               &sepcomps[i]);
+    }
+  }
+
+  // compositions are created afterwards, in stream order, since creating
+  // them is not thread safe and their ids must not depend on thread timing
+  std::vector<SepFrac>& seps = sep_cache_[c->id()];
+  seps.reserve(nstreams);
+  for (int i = 0; i < nstreams; ++i) {
+    seps.push_back(std::make_pair(Composition::CreateFromMass(sepcomps[i]),
+                                  qtys[i]));
+  }
+  return seps;
+}
+
+void Separations::FeedMasses_(Composition::Ptr c, double qty,
+                              std::vector<double>* masses) {
+  const CompMap& cm = c->mass();
+  CompMap::const_iterator it;
+
+  // index any new nuclides before sizing masses so it lines up with the rows
+  double tot = 0;
+  std::vector<int> idx;
+  idx.reserve(cm.size());
+  for (it = cm.begin(); it != cm.end(); ++it) {
+    idx.push_back(NucIndex_(it->first));
+    tot += it->second;
+  }
+
+  masses->assign(nucs_.size(), 0);
+  if (tot <= 0) {
+    return;
+  }
+  int k = 0;
+  for (it = cm.begin(); it != cm.end(); ++it, ++k) {
+    (*masses)[idx[k]] = it->second / tot * qty;
   }
 }
 
+double SepEfficiency(const std::map<int, double>& effs, int nuc) {
+  std::map<int, double>::const_iterator it = effs.find(nuc);
+  if (it != effs.end()) {
+    return it->second;
+  }
+  it = effs.find((nuc / 10000000) * 10000000);
+  if (it != effs.end()) {
+    return it->second;
+  }
+  return 0;
+}
+
 // Note that this returns an untracked material that should just be used for
 // its composition and qty - not in any real inventories, etc.
-Material::Ptr SepMaterial(std::map<int, double> effs, Material::Ptr mat) {
+Material::Ptr SepMaterial(const std::map<int, double>& effs,
+                          Material::Ptr mat) {
   CompMap cm = mat->comp()->mass();
   cyclus::compmath::Normalize(&cm, mat->quantity());
   double tot_qty = 0;
@@ -156,13 +360,8 @@ Material::Ptr SepMaterial(std::map<int, double> effs, Material::Ptr mat) {
   CompMap::iterator it;
   for (it = cm.begin(); it != cm.end(); ++it) {
     int nuc = it->first;
-    int elem = (nuc / 10000000) * 10000000;
-    double eff = 0;
-    if (effs.count(nuc) > 0) {
-      eff = effs[nuc];
-    } else if (effs.count(elem) > 0) {
-      eff = effs[elem];
-    } else {
+    double eff = SepEfficiency(effs, nuc);
+    if (eff == 0) {
       continue;
     }
 
@@ -176,6 +375,55 @@ Material::Ptr SepMaterial(std::map<int, double> effs, Material::Ptr mat) {
   return Material::CreateUntracked(tot_qty, c);
 };
 
+// fills sepcomp with the nonzero separated masses of the dense feed masses
+// for one stream row and returns their total.  This touches no shared state
+// so streams can be separated concurrently.
+double SepDenseMasses(const std::vector<int>& nucs,
+                      const std::vector<double>& row,
+                      const std::vector<double>& masses, CompMap* sepcomp) {
+  int n = masses.size();
+  std::vector<double> sep(n);
+  // kept as a plain loop over contiguous arrays so that it vectorizes
+  for (int i = 0; i < n; ++i) {
+    sep[i] = row[i] * masses[i];
+  }
+
+  double tot_qty = 0;
+  for (int i = 0; i < n; ++i) {
+    if (sep[i] > 0) {
+      (*sepcomp)[nucs[i]] = sep[i];
+      tot_qty += sep[i];
+    }
+  }
+  return tot_qty;
+}
+
+Material::Ptr SepDense(const std::vector<int>& nucs,
+                       const std::vector<double>& row,
+                       const std::vector<double>& masses) {
+  CompMap sepcomp;
+  double tot_qty = SepDenseMasses(nucs, row, masses, &sepcomp);
+  Composition::Ptr c = Composition::CreateFromMass(sepcomp);
+  return Material::CreateUntracked(tot_qty, c);
+}
+
+MatVec PopLots(ResBuf<Material>* buf, double qty) {
+  MatVec lots;
+  while (qty > cyclus::eps() && !buf->empty()) {
+    // whole lots are popped by count, because ResBuf::Pop(q) pops nothing
+    // for a lot at or below eps_rsrc
+    Material::Ptr m;
+    if (buf->Peek()->quantity() <= qty + cyclus::eps_rsrc()) {
+      m = buf->Pop();
+    } else {
+      m = buf->Pop(qty);
+    }
+    qty -= m->quantity();
+    lots.push_back(m);
+  }
+  return lots;
+}
+
 std::set<cyclus::RequestPortfolio<Material>::Ptr>
 Separations::GetMatlRequests() {
   using cyclus::RequestPortfolio;
@@ -216,22 +464,68 @@ void Separations::GetMatlTrades(
         responses) {
   using cyclus::Trade;
 
-  std::vector<cyclus::Trade<cyclus::Material> >::const_iterator it;
   for (int i = 0; i < trades.size(); i++) {
-    std::string commod = trades[i].request->commodity();
-    if (commod == leftover_commod) {
-      double amt = std::min(leftover.quantity(), trades[i].amt);
-      Material::Ptr m = leftover.Pop(amt);
-      responses.push_back(std::make_pair(trades[i], m));
-    } else if (streambufs.count(commod) > 0) {
-      double amt = std::min(streambufs[commod].quantity(), trades[i].amt);
-      Material::Ptr m = streambufs[commod].Pop(amt);
-      responses.push_back(std::make_pair(trades[i], m));
-    } else {
-      throw ValueError("invalid commodity " + commod +
+    std::map<Request<Material>*, ResBuf<Material>*>::iterator found =
+        req_bufs_.find(trades[i].request);
+    if (found == req_bufs_.end()) {
+      throw ValueError("invalid commodity " + trades[i].request->commodity() +
                        " on trade matched to prototype " + prototype());
     }
+    ResBuf<Material>* buf = found->second;
+    double amt = std::min(buf->quantity(), trades[i].amt);
+    Material::Ptr m;
+    if (aggregate_bids) {
+      m = PopComp_(buf, amt, trades[i].bid->offer()->comp());
+    } else {
+      m = buf->Pop(amt);
+    }
+    responses.push_back(std::make_pair(trades[i], m));
+  }
+}
+
+Material::Ptr Separations::PopComp_(ResBuf<Material>* buf, double qty,
+                                    Composition::Ptr c) {
+  MatVec mats = buf->PopN(buf->count());
+  MatVec keep;
+  Material::Ptr out;
+  for (int i = 0; i < mats.size(); ++i) {
+    Material::Ptr m = mats[i];
+    Material::Ptr piece;
+    if (qty < cyclus::eps() || m->comp() != c) {
+      keep.push_back(m);
+      continue;
+    } else if (m->quantity() > qty) {
+      piece = m->ExtractQty(qty);
+      keep.push_back(m);
+    } else {
+      piece = m;
+    }
+
+    qty -= piece->quantity();
+    if (!out) {
+      out = piece;
+    } else {
+      out->Absorb(piece);
+    }
+  }
+  buf->Push(keep);
+
+  // the exchange caps each composition at its stock, so any shortfall is
+  // rounding; take it from the front of the buffer
+  if (qty > cyclus::eps() && buf->quantity() > cyclus::eps()) {
+    Material::Ptr rest = buf->Pop(std::min(qty, buf->quantity()));
+    if (!out) {
+      out = rest;
+    } else {
+      out->Absorb(rest);
+    }
+  }
+
+  if (!out) {
+    throw ValueError("no material left to trade in prototype " +
+                     prototype());
   }
+  return out;
 }
 
 void Separations::AcceptMatlTrades(const std::vector<
@@ -248,81 +542,95 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Separations::GetMatlBids(
     cyclus::CommodMap<Material>::type& commod_requests) {
   using cyclus::BidPortfolio;
 
-  bool exclusive = false;
   std::set<BidPortfolio<Material>::Ptr> ports;
+  req_bufs_.clear();
 
   // bid streams
-  std::map<std::string, ResBuf<Material> >::iterator it;
-  for (it = streambufs.begin(); it != streambufs.end(); ++it) {
-    std::string commod = it->first;
-    std::vector<Request<Material>*>& reqs = commod_requests[commod];
-    if (reqs.size() == 0) {
+  cyclus::CommodMap<Material>::type::iterator found;
+  for (int i = 0; i < sepstreams_.size(); ++i) {
+    SepStream& s = sepstreams_[i];
+    found = commod_requests.find(s.commod);
+    if (found == commod_requests.end() || found->second.size() == 0) {
       continue;
-    } else if (streambufs[commod].quantity() < cyclus::eps()) {
+    } else if (s.buf->quantity() < cyclus::eps()) {
       continue;
     }
+    ports.insert(BidBuf_(s.buf, found->second));
+  }
 
-    MatVec mats = streambufs[commod].PopN(streambufs[commod].count());
-    streambufs[commod].Push(mats);
-
-    BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
+  // bid leftovers
+  found = commod_requests.find(leftover_commod);
+  if (found != commod_requests.end() && found->second.size() > 0 &&
+      leftover.quantity() >= cyclus::eps()) {
+    ports.insert(BidBuf_(&leftover, found->second));
+  }
 
-    for (int j = 0; j < reqs.size(); j++) {
-      Request<Material>* req = reqs[j];
-      double tot_bid = 0;
-      for (int k = 0; k < mats.size(); k++) {
-        Material::Ptr m = mats[k];
-        tot_bid += m->quantity();
+  return ports;
+}
 
-        // this fix the problem of the cyclus exchange manager which crashes when a bid with a quantity <=0 is offered.
-        if(m->quantity() > cyclus::eps()){
-          port->AddBid(req, m, this, exclusive);
-        }
+cyclus::BidPortfolio<Material>::Ptr Separations::BidBuf_(
+    ResBuf<Material>* buf, const std::vector<Request<Material>*>& reqs) {
+  using cyclus::BidPortfolio;
 
-        if (tot_bid >= req->target()->quantity()) {
-          break;
-        }
+  bool exclusive = false;
+  MatVec mats = buf->PopN(buf->count());
+  buf->Push(mats);
+
+  if (aggregate_bids) {
+    // offer each distinct composition once for its total quantity; trades
+    // are filled from the matching lots in GetMatlTrades
+    std::map<int, int> group;
+    MatVec offers;
+    for (int k = 0; k < mats.size(); k++) {
+      Material::Ptr m = mats[k];
+      std::map<int, int>::iterator g = group.find(m->comp()->id());
+      if (g == group.end()) {
+        group[m->comp()->id()] = offers.size();
+        offers.push_back(Material::CreateUntracked(m->quantity(), m->comp()));
+      } else {
+        offers[g->second]->Absorb(
+            Material::CreateUntracked(m->quantity(), m->comp()));
       }
     }
-
-    double tot_qty = streambufs[commod].quantity();
-    cyclus::CapacityConstraint<Material> cc(tot_qty);
-    port->AddConstraint(cc);
-    ports.insert(port);
+    mats = offers;
   }
 
-  // bid leftovers
-  std::vector<Request<Material>*>& reqs = commod_requests[leftover_commod];
-  if (reqs.size() > 0 && leftover.quantity() >= cyclus::eps()) {
-    MatVec mats = leftover.PopN(leftover.count());
-    leftover.Push(mats);
-
-    BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
-
-    for (int j = 0; j < reqs.size(); j++) {
-      Request<Material>* req = reqs[j];
-      double tot_bid = 0;
-      for (int k = 0; k < mats.size(); k++) {
-        Material::Ptr m = mats[k];
-        tot_bid += m->quantity();
-
-        // this fix the problem of the cyclus exchange manager which crashes when a bid with a quantity <=0 is offered.
-        if(m->quantity() > cyclus::eps()){
-          port->AddBid(req, m, this, exclusive);
-        }
+  BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
 
-        if (tot_bid >= req->target()->quantity()) {
-          break;
-        }
+  for (int j = 0; j < reqs.size(); j++) {
+    Request<Material>* req = reqs[j];
+    req_bufs_[req] = buf;
+    double tot_bid = 0;
+    for (int k = 0; k < mats.size(); k++) {
+      Material::Ptr m = mats[k];
+      tot_bid += m->quantity();
+
+      // this fix the problem of the cyclus exchange manager which crashes when a bid with a quantity <=0 is offered.
+      if(m->quantity() > cyclus::eps()){
+        port->AddBid(req, m, this, exclusive);
       }
-    }
 
-    cyclus::CapacityConstraint<Material> cc(leftover.quantity());
-    port->AddConstraint(cc);
-    ports.insert(port);
+      if (tot_bid >= req->target()->quantity()) {
+        break;
+      }
+    }
   }
 
-  return ports;
+  cyclus::CapacityConstraint<Material> cc(buf->quantity());
+  port->AddConstraint(cc);
+  if (aggregate_bids) {
+    // every request is offered every composition, so each composition is
+    // capped at its own stock
+    for (int k = 0; k < mats.size(); k++) {
+      if (mats[k]->quantity() <= cyclus::eps()) {
+        continue;
+      }
+      cyclus::Converter<Material>::Ptr conv(new CompConverter(mats[k]->comp()));
+      port->AddConstraint(
+          cyclus::CapacityConstraint<Material>(mats[k]->quantity(), conv));
+    }
+  }
+  return port;
 }
 
 void Separations::Tock() {}
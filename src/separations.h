@@ -13,9 +13,38 @@ namespace cycamore {
 /// separations efficiency for that nuclide or element.  Note that this returns
 /// an untracked material that should only be used for its composition and qty
 /// - not in any real inventories, etc.
-cyclus::Material::Ptr SepMaterial(std::map<int, double> effs,
+cyclus::Material::Ptr SepMaterial(const std::map<int, double>& effs,
                                   cyclus::Material::Ptr mat);
 
+/// SepEfficiency returns the separations efficiency that effs assigns to the
+/// nuclide nuc: its own efficiency if listed, otherwise the efficiency of its
+/// element, otherwise zero.
+double SepEfficiency(const std::map<int, double>& effs, int nuc);
+
+/// SepDense is the dense form of SepMaterial.  masses holds the feed mass of
+/// each nuclide in nucs (same order) and row holds the corresponding
+/// efficiencies (see SepEfficiency).  The separated material is returned as
+/// an untracked material with the same caveats as SepMaterial.
+cyclus::Material::Ptr SepDense(const std::vector<int>& nucs,
+                               const std::vector<double>& row,
+                               const std::vector<double>& masses);
+
+/// PopLots pops up to qty kg from the front of buf as separate lots.  Lots
+/// that fit (within cyclus::eps_rsrc) are popped whole, however small, and
+/// only the last one is split.
+cyclus::toolkit::MatVec PopLots(cyclus::toolkit::ResBuf<cyclus::Material>* buf,
+                                double qty);
+
+/// SepStream is a separations stream compiled for the per-time-step path: its
+/// commodity, its output buffer and a dense efficiency row over the owning
+/// facility's nuclide index.
+struct SepStream {
+  std::string commod;
+  cyclus::toolkit::ResBuf<cyclus::Material>* buf;
+  const std::map<int, double>* effs;
+  std::vector<double> row;
+};
+
 /// Separations processes feed material into one or more streams containing
 /// specific elements and/or nuclides.  It uses mass-based efficiencies.
 ///
@@ -149,6 +178,36 @@ class Separations : public cyclus::Facility {
   }
   double throughput;
 
+  #pragma cyclus var { \
+    "default": 0, \
+    "userlevel": 10, \
+    "uilabel": "Separate Feed Lot by Lot", \
+    "doc": "If true, feed is processed lot by lot in the order it was " \
+           "received (up to the throughput) and each lot is separated " \
+           "with its own composition instead of first being mixed with the " \
+           "rest of the feed processed that time step.", \
+  }
+  bool process_lots;
+
+  #pragma cyclus var { \
+    "default": 0, \
+    "userlevel": 10, \
+    "uilabel": "Aggregate Stream Bids", \
+    "doc": "If true, each stream (and the leftovers) bids on a request with " \
+           "one offer per distinct composition in its inventory instead of " \
+           "one offer per stored material lot.", \
+  }
+  bool aggregate_bids;
+
+  #pragma cyclus var { \
+    "default": 1, \
+    "userlevel": 10, \
+    "uilabel": "Separations Threads", \
+    "doc": "Number of threads used to separate the streams of a newly seen " \
+           "feed composition. Results do not depend on this value.", \
+  }
+  int sep_threads;
+
   #pragma cyclus var { \
     "doc": "Commodity on which to trade the leftover separated material " \
            "stream. This MUST NOT be the same as any commodity used to define "\
@@ -198,6 +257,56 @@ class Separations : public cyclus::Facility {
   // custom SnapshotInv and InitInv and EnterNotify are used to persist this
   // state var.
   std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> > streambufs;
+
+  /// returns the dense index of nuc, adding it to nucs_ and extending every
+  /// stream's efficiency row if it has not been seen before.
+  int NucIndex_(int nuc);
+
+  /// returns a bid portfolio offering the contents of buf to reqs and
+  /// remembers buf as the source for trades on those requests.
+  cyclus::BidPortfolio<cyclus::Material>::Ptr BidBuf_(
+      cyclus::toolkit::ResBuf<cyclus::Material>* buf,
+      const std::vector<cyclus::Request<cyclus::Material>*>& reqs);
+
+  /// pops qty kg of material with composition c from buf, leaving the
+  /// relative order of the remaining material unchanged. Any shortfall is
+  /// popped from the front of buf.
+  cyclus::Material::Ptr PopComp_(
+      cyclus::toolkit::ResBuf<cyclus::Material>* buf, double qty,
+      cyclus::Composition::Ptr c);
+
+  /// separates the given feed lots into the stream buffers and leftovers,
+  /// scaled back uniformly if any stream buffer lacks space.
+  void SeparateLots_(const cyclus::toolkit::MatVec& lots);
+
+  /// fills masses with the dense mass vector over nucs_ of qty kg of
+  /// material with composition c.
+  void FeedMasses_(cyclus::Composition::Ptr c, double qty,
+                   std::vector<double>* masses);
+
+  /// composition and mass fraction of feed separated into each stream (in
+  /// sepstreams_ order) for one kg of feed with composition c.
+  typedef std::pair<cyclus::Composition::Ptr, double> SepFrac;
+
+  /// returns the per-stream separation results for feed of composition c,
+  /// computing them only the first time c is seen.
+  const std::vector<SepFrac>& Separate_(cyclus::Composition::Ptr c);
+
+  // nuclides indexing the dense efficiency rows and feed mass vectors.
+  std::vector<int> nucs_;
+  std::map<int, int> nuc_index_;
+
+  // streams compiled at EnterNotify, in streams_ order.
+  std::vector<SepStream> sepstreams_;
+
+  // intra-time-step state - no need to be a state var
+  // map<request, buffer bid on it>
+  std::map<cyclus::Request<cyclus::Material>*,
+           cyclus::toolkit::ResBuf<cyclus::Material>*> req_bufs_;
+
+  // per-stream separation results keyed by feed composition id.  Reusing the
+  // cached compositions also keeps output composition ids stable.
+  std::map<int, std::vector<SepFrac> > sep_cache_;
 };
 
 }  // namespace cycamore
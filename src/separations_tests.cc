@@ -1,6 +1,7 @@
 #include "separations.h"
 
 #include <gtest/gtest.h>
+#include <cmath>
 #include <sstream>
 #include "cyclus.h"
 
@@ -43,8 +44,79 @@ TEST(SeparationsTests, SepMaterial) {
   EXPECT_DOUBLE_EQ(0, mqsep.mass("Am242"));
 }
 
+TEST(SeparationsTests, SepDense) {
+  // the dense kernel must agree with SepMaterial, including element fallbacks
+  CompMap comp;
+  comp[id("U235")] = 10;
+  comp[id("U238")] = 90;
+  comp[id("Pu239")] = 1;
+  comp[id("Pu240")] = 2;
+  comp[id("Am241")] = 3;
+  comp[id("Am242")] = 2.8;
+  double qty = 100;
+  Composition::Ptr c = Composition::CreateFromMass(comp);
+  Material::Ptr mat = Material::CreateUntracked(qty, c);
+
+  std::map<int, double> effs;
+  effs[id("U")] = .7;
+  effs[id("Pu")] = .4;
+  effs[id("Pu240")] = .1;
+  effs[id("Am241")] = .4;
+
+  EXPECT_DOUBLE_EQ(.7, SepEfficiency(effs, id("U238")));
+  EXPECT_DOUBLE_EQ(.4, SepEfficiency(effs, id("Pu239")));
+  EXPECT_DOUBLE_EQ(.1, SepEfficiency(effs, id("Pu240")));
+  EXPECT_DOUBLE_EQ(0, SepEfficiency(effs, id("Am242")));
+
+  std::vector<int> nucs;
+  std::vector<double> row;
+  std::vector<double> masses;
+  MatQuery mqorig(mat);
+  CompMap::iterator it;
+  for (it = comp.begin(); it != comp.end(); ++it) {
+    nucs.push_back(it->first);
+    row.push_back(SepEfficiency(effs, it->first));
+    masses.push_back(mqorig.mass(it->first));
+  }
+
+  Material::Ptr want = SepMaterial(effs, mat);
+  Material::Ptr got = SepDense(nucs, row, masses);
+  MatQuery mqwant(want);
+  MatQuery mqgot(got);
+  EXPECT_NEAR(want->quantity(), got->quantity(), 1e-10);
+  for (it = comp.begin(); it != comp.end(); ++it) {
+    EXPECT_NEAR(mqwant.mass(it->first), mqgot.mass(it->first), 1e-10)
+        << "nuclide " << it->first;
+  }
+}
+
   
 // Check that cumulative separations efficiency for a single nuclide of less than or equal to one does not trigger an error.
+TEST(SeparationsTests, PopLots) {
+  // lots at or below eps_rsrc at the front of the buffer are popped whole
+  // instead of stalling the loop
+  CompMap comp;
+  comp[id("U235")] = 1;
+  Composition::Ptr c = Composition::CreateFromMass(comp);
+  cyclus::toolkit::ResBuf<Material> buf;
+  buf.Push(Material::CreateUntracked(1e-9, c));
+  buf.Push(Material::CreateUntracked(10, c));
+  buf.Push(Material::CreateUntracked(5, c));
+
+  cyclus::toolkit::MatVec lots = PopLots(&buf, 12);
+  ASSERT_EQ(3, lots.size());
+  EXPECT_DOUBLE_EQ(1e-9, lots[0]->quantity());
+  EXPECT_DOUBLE_EQ(10, lots[1]->quantity());
+  EXPECT_NEAR(2, lots[2]->quantity(), 1e-8);
+  EXPECT_NEAR(3, buf.quantity(), 1e-8);
+
+  buf.PopN(buf.count());
+  buf.Push(Material::CreateUntracked(1e-9, c));
+  lots = PopLots(&buf, 5);
+  ASSERT_EQ(1, lots.size());
+  EXPECT_TRUE(buf.empty());
+}
+
 TEST(SeparationsTests, SeparationEfficiency) {
 
   int simdur = 2;
@@ -281,6 +353,325 @@ TEST(SeparationsTests, SepMixElemAndNuclide) {
   EXPECT_DOUBLE_EQ(0, mq.mass("Pu240"));
 }
 
+TEST(SeparationsTests, SepCache) {
+  // repeat separations of the same feed composition reuse one output
+  // composition
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>stream1</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>0.6</eff></item>"
+      "                <item><comp>Pu239</comp> <eff>.7</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>feed</val> </feed_commods>"
+     ;
+
+  CompMap m;
+  m[id("u235")] = 0.08;
+  m[id("u238")] = 0.9;
+  m[id("Pu239")] = .01;
+  m[id("Pu240")] = .01;
+  Composition::Ptr c = Composition::CreateFromMass(m);
+
+  int simdur = 4;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("feed").recipe("recipe1").Finalize();
+  sim.AddSink("stream1").capacity(100).Finalize();
+  sim.AddRecipe("recipe1", c);
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(simdur - 1, qr.rows.size());
+
+  std::set<int> qualids;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    std::vector<Cond> rconds;
+    rconds.push_back(Cond("ResourceId", "==", qr.GetVal<int>("ResourceId", i)));
+    QueryResult rq = sim.db().Query("Resources", &rconds);
+    qualids.insert(rq.GetVal<int>("QualId"));
+
+    MatQuery mq(sim.GetMaterial(qr.GetVal<int>("ResourceId", i)));
+    EXPECT_DOUBLE_EQ(m[922350000]*0.6*100, mq.mass("U235"));
+    EXPECT_DOUBLE_EQ(m[942390000]*0.7*100, mq.mass("Pu239"));
+  }
+  EXPECT_EQ(1, qualids.size());
+}
+
+TEST(SeparationsTests, ProcessLots) {
+  // feed lots with different compositions are separated individually rather
+  // than mixed together first
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>stream1</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>0.5</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>feed</val> </feed_commods>"
+      "<process_lots>1</process_lots>"
+     ;
+
+  CompMap m1;
+  m1[id("u235")] = 0.1;
+  m1[id("u238")] = 0.9;
+  CompMap m2;
+  m2[id("u235")] = 0.2;
+  m2[id("u238")] = 0.8;
+
+  int simdur = 3;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("feed").recipe("recipe1").capacity(50).Finalize();
+  sim.AddSource("feed").recipe("recipe2").capacity(50).Finalize();
+  sim.AddSink("stream1").capacity(100).Finalize();
+  sim.AddRecipe("recipe1", Composition::CreateFromMass(m1));
+  sim.AddRecipe("recipe2", Composition::CreateFromMass(m2));
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(2 * (simdur - 1), qr.rows.size());
+
+  double tot = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    MatQuery mq(m);
+    double frac = mq.mass("U235") / m->quantity();
+    EXPECT_TRUE(std::abs(frac - 0.1) < 1e-10 || std::abs(frac - 0.2) < 1e-10)
+        << "separated lot has mixed composition, U235 fraction " << frac;
+    tot += m->quantity();
+  }
+  EXPECT_NEAR(0.5 * 100 * (simdur - 1), tot, 1e-8);
+}
+
+TEST(SeparationsTests, AggregateBids) {
+  // aggregated bids are filled only from stream lots of the offered
+  // composition
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>stream1</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>0.5</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>feed</val> </feed_commods>"
+      "<process_lots>1</process_lots>"
+      "<aggregate_bids>1</aggregate_bids>"
+     ;
+
+  CompMap m1;
+  m1[id("u235")] = 0.1;
+  m1[id("u238")] = 0.9;
+  CompMap m2;
+  m2[id("u235")] = 0.2;
+  m2[id("u238")] = 0.8;
+
+  int simdur = 5;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("feed").recipe("recipe1").capacity(10).Finalize();
+  sim.AddSource("feed").recipe("recipe1").capacity(10).Finalize();
+  sim.AddSource("feed").recipe("recipe2").capacity(10).Finalize();
+  sim.AddSink("stream1").capacity(7).Finalize();
+  sim.AddRecipe("recipe1", Composition::CreateFromMass(m1));
+  sim.AddRecipe("recipe2", Composition::CreateFromMass(m2));
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_GT(qr.rows.size(), 0);
+
+  double tot = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    MatQuery mq(m);
+    double frac = mq.mass("U235") / m->quantity();
+    EXPECT_TRUE(std::abs(frac - 0.1) < 1e-10 || std::abs(frac - 0.2) < 1e-10)
+        << "traded material has mixed composition, U235 fraction " << frac;
+    tot += m->quantity();
+  }
+  EXPECT_NEAR(7 * (simdur - 1), tot, 1e-8);
+}
+
+TEST(SeparationsTests, AggregateBidsTwoSinks) {
+  // two sinks sharing aggregated bids on two compositions never take more
+  // of a composition than the stream holds
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>stream1</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>0.5</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>feed</val> </feed_commods>"
+      "<process_lots>1</process_lots>"
+      "<aggregate_bids>1</aggregate_bids>"
+     ;
+
+  CompMap m1;
+  m1[id("u235")] = 0.1;
+  m1[id("u238")] = 0.9;
+  CompMap m2;
+  m2[id("u235")] = 0.2;
+  m2[id("u238")] = 0.8;
+
+  // 10 kg of the first and 5 kg of the second composition are separated
+  // each step, against 24 kg of demand
+  int simdur = 5;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("feed").recipe("recipe1").capacity(20).Finalize();
+  sim.AddSource("feed").recipe("recipe2").capacity(10).Finalize();
+  sim.AddSink("stream1").capacity(12).Finalize();
+  sim.AddSink("stream1").capacity(12).Finalize();
+  sim.AddRecipe("recipe1", Composition::CreateFromMass(m1));
+  sim.AddRecipe("recipe2", Composition::CreateFromMass(m2));
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_GT(qr.rows.size(), 0);
+
+  double tot = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    MatQuery mq(m);
+    double frac = mq.mass("U235") / m->quantity();
+    EXPECT_TRUE(std::abs(frac - 0.1) < 1e-10 || std::abs(frac - 0.2) < 1e-10)
+        << "traded material has mixed composition, U235 fraction " << frac;
+    tot += m->quantity();
+  }
+  EXPECT_NEAR(15 * (simdur - 1), tot, 1e-8);
+}
+
+TEST(SeparationsTests, SepThreads) {
+  // threaded separation gives bitwise the same results as serial separation
+  std::string streams =
+      "<streams>"
+      "    <item>"
+      "        <commod>ustream</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>0.99</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "    <item>"
+      "        <commod>pustream</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>Pu</comp> <eff>0.97</eff></item>"
+      "                <item><comp>U</comp> <eff>0.003</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "    <item>"
+      "        <commod>amstream</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>Am</comp> <eff>0.9</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>feed</val> </feed_commods>"
+     ;
+
+  CompMap m;
+  m[id("u235")] = 0.01;
+  m[id("u238")] = 0.95;
+  m[id("Pu239")] = .02;
+  m[id("Pu240")] = .01;
+  m[id("Am241")] = .007;
+  m[id("Cs137")] = .003;
+  Composition::Ptr c = Composition::CreateFromMass(m);
+
+  std::string commods[] = {"ustream", "pustream", "amstream"};
+  std::map<std::string, CompMap> got[2];
+  for (int run = 0; run < 2; run++) {
+    std::string config = streams;
+    if (run == 1) {
+      config += "<sep_threads>3</sep_threads>";
+    }
+    int simdur = 2;
+    cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config,
+                        simdur);
+    sim.AddSource("feed").recipe("recipe1").Finalize();
+    for (int i = 0; i < 3; i++) {
+      sim.AddSink(commods[i]).capacity(100).Finalize();
+    }
+    sim.AddRecipe("recipe1", c);
+    int id = sim.Run();
+
+    std::vector<Cond> conds;
+    conds.push_back(Cond("SenderId", "==", id));
+    QueryResult qr = sim.db().Query("Transactions", &conds);
+    ASSERT_EQ(3, qr.rows.size());
+    for (int i = 0; i < qr.rows.size(); i++) {
+      Material::Ptr mat = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+      CompMap cm = mat->comp()->mass();
+      cyclus::compmath::Normalize(&cm, mat->quantity());
+      got[run][qr.GetVal<std::string>("Commodity", i)] = cm;
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    CompMap& serial = got[0][commods[i]];
+    CompMap& threaded = got[1][commods[i]];
+    ASSERT_EQ(serial.size(), threaded.size()) << commods[i];
+    for (CompMap::iterator it = serial.begin(); it != serial.end(); ++it) {
+      EXPECT_EQ(it->second, threaded[it->first])
+          << commods[i] << " nuclide " << it->first;
+    }
+  }
+}
+
 TEST(SeparationsTests, Retire) {
   std::string config =
       "<streams>"
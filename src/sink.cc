@@ -11,7 +11,9 @@ namespace cycamore {
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Sink::Sink(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
-      capacity(std::numeric_limits<double>::max()) {
+      capacity(std::numeric_limits<double>::max()),
+      keep_inventory(true),
+      released_qty(0) {
   SetMaxInventorySize(std::numeric_limits<double>::max());
 }
 
@@ -56,27 +58,45 @@ std::string Sink::str() {
   return "" + ss.str();
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sink::EnterNotify() {
+  cyclus::Facility::EnterNotify();
+
+  if (!recipe_name.empty()) {
+    recipe_comp_ = context()->GetRecipe(recipe_name);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+cyclus::Material::Ptr Sink::RequestMat_(double amt) {
+  if (req_mat_ && req_mat_->quantity() == amt) {
+    return req_mat_;
+  }
+
+  if (recipe_name.empty()) {
+    req_mat_ = cyclus::NewBlankMaterial(amt);
+  } else {
+    if (!recipe_comp_) {
+      recipe_comp_ = context()->GetRecipe(recipe_name);
+    }
+    req_mat_ = cyclus::Material::CreateUntracked(amt, recipe_comp_);
+  }
+  return req_mat_;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 std::set<cyclus::RequestPortfolio<cyclus::Material>::Ptr>
 Sink::GetMatlRequests() {
   using cyclus::Material;
   using cyclus::RequestPortfolio;
   using cyclus::Request;
-  using cyclus::Composition;
 
   std::set<RequestPortfolio<Material>::Ptr> ports;
   RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
   double amt = RequestAmt();
-  Material::Ptr mat;
-
-  if (recipe_name.empty()) {
-    mat = cyclus::NewBlankMaterial(amt);
-  } else {
-    Composition::Ptr rec = this->context()->GetRecipe(recipe_name);
-    mat = cyclus::Material::CreateUntracked(amt, rec); 
-  } 
 
   if (amt > cyclus::eps()) {
+    Material::Ptr mat = RequestMat_(amt);
     std::vector<std::string>::const_iterator it;
     std::vector<Request<Material>*> mutuals;
     for (it = in_commods.begin(); it != in_commods.end(); ++it) {
@@ -106,11 +126,15 @@ Sink::GetGenRsrcRequests() {
     CapacityConstraint<Product> cc(amt);
     port->AddConstraint(cc);
 
+    // one untracked product serves as the target of every request
+    if (!req_prod_ || req_prod_->quantity() != amt) {
+      std::string quality = "";  // not clear what this should be..
+      req_prod_ = Product::CreateUntracked(amt, quality);
+    }
+
     std::vector<std::string>::const_iterator it;
     for (it = in_commods.begin(); it != in_commods.end(); ++it) {
-      std::string quality = "";  // not clear what this should be..
-      Product::Ptr rsrc = Product::CreateUntracked(amt, quality);
-      port->AddRequest(rsrc, this, *it);
+      port->AddRequest(req_prod_, this, *it);
     }
 
     ports.insert(port);
@@ -126,7 +150,11 @@ void Sink::AcceptMatlTrades(
   std::vector< std::pair<cyclus::Trade<cyclus::Material>,
                          cyclus::Material::Ptr> >::const_iterator it;
   for (it = responses.begin(); it != responses.end(); ++it) {
-    inventory.Push(it->second);
+    if (keep_inventory) {
+      inventory.Push(it->second);
+    } else {
+      Account_(it->first.request->commodity(), it->second);
+    }
   }
 }
 
@@ -137,7 +165,29 @@ void Sink::AcceptGenRsrcTrades(
   std::vector< std::pair<cyclus::Trade<cyclus::Product>,
                          cyclus::Product::Ptr> >::const_iterator it;
   for (it = responses.begin(); it != responses.end(); ++it) {
-    inventory.Push(it->second);
+    if (keep_inventory) {
+      inventory.Push(it->second);
+    } else {
+      Account_(it->first.request->commodity(), it->second);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sink::Account_(const std::string& commod, cyclus::Resource::Ptr r) {
+  // the transaction recording the receipt is already logged, so only the
+  // totals are needed from here on
+  double qty = r->quantity();
+  released_qty += qty;
+  received_by_commod[commod] += qty;
+
+  if (r->type() == cyclus::Material::kType) {
+    cyclus::Material::Ptr m = cyclus::ResCast<cyclus::Material>(r);
+    cyclus::CompMap v = m->comp()->mass();
+    cyclus::compmath::Normalize(&v, qty);
+    for (cyclus::CompMap::iterator it = v.begin(); it != v.end(); ++it) {
+      received_comp[it->first] += it->second;
+    }
   }
 }
 
@@ -168,7 +218,7 @@ void Sink::Tock() {
   // Maybe someday it will record things.
   // For now, lets just print out what we have at each timestep.
   LOG(cyclus::LEV_INFO4, "SnkFac") << "Sink " << this->id()
-                                   << " is holding " << inventory.quantity()
+                                   << " is holding " << InventorySize()
                                    << " units of material at the close of month "
                                    << context()->time() << ".";
   LOG(cyclus::LEV_INFO3, "SnkFac") << "}";
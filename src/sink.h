@@ -2,6 +2,7 @@
 #define CYCAMORE_SRC_SINK_H_
 
 #include <algorithm>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -40,6 +41,8 @@ class Sink : public cyclus::Facility  {
 
   virtual std::string str();
 
+  virtual void EnterNotify();
+
   virtual void Tick();
 
   virtual void Tock();
@@ -79,18 +82,35 @@ class Sink : public cyclus::Facility  {
   /// @return the maximum inventory storage size
   inline double MaxInventorySize() const { return inventory.capacity(); }
 
-  /// @return the current inventory storage size
-  inline double InventorySize() const { return inventory.quantity(); }
+  /// @return the current inventory storage size, including material that
+  /// was only accounted for (see keep_inventory)
+  inline double InventorySize() const {
+    return inventory.quantity() + released_qty;
+  }
 
   /// determines the amount to request
   inline double RequestAmt() const {
-    return std::min(capacity, std::max(0.0, inventory.space()));
+    return std::min(capacity, std::max(0.0, inventory.space() - released_qty));
+  }
+
+  /// @return the quantity received on each commodity while not keeping
+  /// inventory
+  inline const std::map<std::string, double>& ReceivedByCommod() const {
+    return received_by_commod;
   }
 
+  /// @return the summed nuclide masses of material received while not
+  /// keeping inventory
+  inline const cyclus::CompMap& ReceivedComp() const { return received_comp; }
+
   /// sets the capacity of a material generated at any given time step
   /// @param capacity the reception capacity
   inline void Capacity(double cap) { capacity = cap; }
 
+  /// sets whether received resources are held in inventory
+  /// @param keep false to keep only running totals (see keep_inventory)
+  inline void KeepInventory(bool keep) { keep_inventory = keep; }
+
   /// @return the reception capacity at any given time step
   inline double Capacity() const { return capacity; }
 
@@ -128,9 +148,47 @@ class Sink : public cyclus::Facility  {
                              "accept at each time step"}
   double capacity;
 
+  /// whether received resources are held or only accounted for
+  #pragma cyclus var {"default": True, \
+                      "tooltip": "keep received resources", \
+                      "uilabel": "Keep Inventory", \
+                      "userlevel": 10, \
+                      "doc": "if true (default) received resources are held " \
+                             "in inventory. Otherwise each receipt is still " \
+                             "recorded but only running totals (quantity per " \
+                             "commodity and summed nuclide masses) are kept " \
+                             "and the resources themselves are released."}
+  bool keep_inventory;
+
   /// this facility holds material in storage.
   #pragma cyclus var {'capacity': 'max_inv_size'}
   cyclus::toolkit::ResBuf<cyclus::Resource> inventory;
+
+  /// total quantity received but not held in inventory
+  #pragma cyclus var {"default": 0, "internal": True}
+  double released_qty;
+
+  /// quantity received on each commodity but not held in inventory
+  #pragma cyclus var {"default": {}, "internal": True}
+  std::map<std::string, double> received_by_commod;
+
+  /// summed nuclide masses of material received but not held in inventory
+  #pragma cyclus var {"default": {}, "internal": True}
+  std::map<int, double> received_comp;
+
+  /// adds a received resource to the running totals for commod
+  void Account_(const std::string& commod, cyclus::Resource::Ptr r);
+
+  /// returns the request material for amt, reusing the previous one if the
+  /// amount has not changed
+  cyclus::Material::Ptr RequestMat_(double amt);
+
+  /// composition of recipe_name, resolved once
+  cyclus::Composition::Ptr recipe_comp_;
+
+  // request targets reused while the requested amount is unchanged
+  cyclus::Material::Ptr req_mat_;
+  cyclus::Product::Ptr req_prod_;
 };
 
 }  // namespace cycamore
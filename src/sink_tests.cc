@@ -133,6 +133,31 @@ TEST_F(SinkTest, Requests) {
   EXPECT_EQ(constraints.size(), 0);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(SinkTest, ReuseRequests) {
+  // request targets are reused until the requested amount changes
+  using cyclus::Material;
+  using cyclus::RequestPortfolio;
+
+  std::set<RequestPortfolio<Material>::Ptr> ports1 =
+      src_facility->GetMatlRequests();
+  std::set<RequestPortfolio<Material>::Ptr> ports2 =
+      src_facility->GetMatlRequests();
+  ASSERT_EQ(1, ports1.size());
+  ASSERT_EQ(1, ports2.size());
+  Material::Ptr t1 = ports1.begin()->get()->requests()[0]->target();
+  Material::Ptr t2 = ports2.begin()->get()->requests()[0]->target();
+  EXPECT_EQ(t1, t2);
+
+  src_facility->Capacity(capacity_ / 2);
+  std::set<RequestPortfolio<Material>::Ptr> ports3 =
+      src_facility->GetMatlRequests();
+  ASSERT_EQ(1, ports3.size());
+  Material::Ptr t3 = ports3.begin()->get()->requests()[0]->target();
+  EXPECT_NE(t1, t3);
+  EXPECT_DOUBLE_EQ(capacity_ / 2, t3->quantity());
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(SinkTest, EmptyRequests) {
   using cyclus::Material;
@@ -176,6 +201,52 @@ TEST_F(SinkTest, Accept) {
   src_facility->AcceptMatlTrades(responses);
   EXPECT_DOUBLE_EQ(qty, src_facility->InventorySize());
 }
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(SinkTest, AccountingTotals) {
+  // without keeping inventory, receipts only update the running totals
+  using cyclus::Bid;
+  using cyclus::Material;
+  using cyclus::Request;
+  using cyclus::Trade;
+
+  cyclus::CompMap m;
+  m[922350000] = 1;
+  m[922380000] = 2;
+  cyclus::Composition::Ptr c = cyclus::Composition::CreateFromMass(m);
+
+  src_facility->KeepInventory(false);
+  src_facility->SetMaxInventorySize(20);
+
+  std::vector< std::pair<cyclus::Trade<cyclus::Material>,
+                         cyclus::Material::Ptr> > responses;
+  Request<Material>* req1 = Request<Material>::Create(
+      Material::CreateUntracked(5, c), src_facility, commod1_);
+  Bid<Material>* bid1 = Bid<Material>::Create(
+      req1, Material::CreateUntracked(5, c), trader);
+  Request<Material>* req2 = Request<Material>::Create(
+      Material::CreateUntracked(10, c), src_facility, commod2_);
+  Bid<Material>* bid2 = Bid<Material>::Create(
+      req2, Material::CreateUntracked(10, c), trader);
+  responses.push_back(std::make_pair(Trade<Material>(req1, bid1, 5),
+                                     Material::CreateUntracked(5, c)));
+  responses.push_back(std::make_pair(Trade<Material>(req2, bid2, 10),
+                                     Material::CreateUntracked(10, c)));
+  src_facility->AcceptMatlTrades(responses);
+
+  EXPECT_DOUBLE_EQ(15, src_facility->InventorySize());
+  EXPECT_TRUE(src_facility->SnapshotInv()["inventory"].empty());
+
+  std::map<std::string, double> by_commod = src_facility->ReceivedByCommod();
+  EXPECT_EQ(2, by_commod.size());
+  EXPECT_DOUBLE_EQ(5, by_commod[commod1_]);
+  EXPECT_DOUBLE_EQ(10, by_commod[commod2_]);
+
+  cyclus::CompMap comp = src_facility->ReceivedComp();
+  EXPECT_EQ(2, comp.size());
+  EXPECT_NEAR(5, comp[922350000], 1e-10);
+  EXPECT_NEAR(10, comp[922380000], 1e-10);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(SinkTest, InRecipe){
 // Create a context
@@ -211,6 +282,41 @@ TEST_F(SinkTest, InRecipe){
   EXPECT_EQ(req->commodity(),"some_u");
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(SinkTest, AccountingOnly) {
+  // without keeping inventory, received material still counts against the
+  // maximum inventory size
+  using cyclus::Cond;
+  using cyclus::QueryResult;
+
+  std::string config =
+      "   <in_commods><val>commod</val></in_commods>"
+      "   <capacity>10</capacity>"
+      "   <max_inv_size>15</max_inv_size>"
+      "   <keep_inventory>0</keep_inventory>";
+
+  cyclus::CompMap m;
+  m[922350000] = 1;
+  m[922380000] = 2;
+
+  int simdur = 4;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Sink"), config, simdur);
+  sim.AddSource("commod").recipe("rec").capacity(10).Finalize();
+  sim.AddRecipe("rec", cyclus::Composition::CreateFromMass(m));
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("ReceiverId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(2, qr.rows.size());
+
+  double tot = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    tot += sim.GetMaterial(qr.GetVal<int>("ResourceId", i))->quantity();
+  }
+  EXPECT_DOUBLE_EQ(15, tot);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(SinkTest, Print) {
   EXPECT_NO_THROW(std::string s = src_facility->str());
@@ -6,7 +6,9 @@ namespace storage {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Storage::Storage(cyclus::Context* ctx)
-    : cyclus::Facility(ctx) {
+    : cyclus::Facility(ctx),
+      coalesce_stocks(false),
+      decay_on_release(false) {
   cyclus::Warn<cyclus::EXPERIMENTAL_WARNING>("The Storage Facility is experimental.");
     };
 
@@ -69,6 +71,11 @@ void Storage::EnterNotify() {
     throw cyclus::ValueError(ss.str());
   }
 
+  if (coalesce_stocks && discrete_handling) {
+    throw cyclus::ValueError("coalesce_stocks cannot be combined with "
+                             "discrete_handling in prototype " + prototype());
+  }
+
   for(int i=0; i!=in_commods.size(); ++i) {
     buy_policy.Set(in_commods[i],comp,in_commod_prefs[i]);
   }
@@ -162,18 +169,33 @@ void Storage::AddMat_(cyclus::Material::Ptr mat) {
 
 //- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Storage::BeginProcessing_(){
-  while( inventory.count() > 0 ){
-    try {
-      processing.Push(inventory.Pop());
-      entry_times.push_back(context()->time());
-
-      LOG(cyclus::LEV_DEBUG2, "ComCnv") << "Storage " << prototype() 
-                                      << " added resources to processing at t= "
-                                      << context()->time();
-    } catch (cyclus::Error& e) {
-      e.msg(Agent::InformErrorMsg(e.msg()));
-      throw e;
+  int n = inventory.count();
+  if (n == 0) {
+    return;
+  }
+
+  int t = context()->time();
+  try {
+    cyclus::toolkit::MatVec mats = inventory.PopN(n);
+
+    // per-material logging only when explicitly asked for
+    if (cyclus::Logger::ReportLevel() >= cyclus::LEV_DEBUG3) {
+      for (int i = 0; i < mats.size(); ++i) {
+        LOG(cyclus::LEV_DEBUG3, "ComCnv") << "Storage " << prototype()
+                                          << " added " << mats[i]->quantity()
+                                          << " kg to processing at t= " << t;
+      }
     }
+
+    processing.Push(mats);
+    cohort_counts[t] += n;
+
+    LOG(cyclus::LEV_DEBUG2, "ComCnv") << "Storage " << prototype()
+                                    << " added " << n << " resources to"
+                                    << " processing at t= " << t;
+  } catch (cyclus::Error& e) {
+    e.msg(Agent::InformErrorMsg(e.msg()));
+    throw e;
   }
 }
 
@@ -194,17 +216,27 @@ void Storage::ProcessMat_(double cap){
           stocks.Push(ready.PopN(ready.count()));
         }
         else {
+          // gather the largest whole-material prefix that fits and move it
+          // in one push
+          cyclus::toolkit::MatVec mats;
           double cap_pop = ready.Peek()->quantity();
           while(cap_pop<=max_pop && !ready.empty() ){
-            stocks.Push(ready.Pop());
+            mats.push_back(ready.Pop());
             cap_pop += ready.empty() ? 0 : ready.Peek()->quantity();
           }
+          if (!mats.empty()) {
+            stocks.Push(mats);
+          }
         }
       }
       else {
         stocks.Push(ready.Pop(max_pop));
       }
 
+      if (coalesce_stocks) {
+        CoalesceStocks_();
+      }
+
       LOG(cyclus::LEV_INFO1, "ComCnv") << "Storage " << prototype() 
                                         << " moved resources" 
                                         << " from ready to stocks" 
@@ -216,18 +248,50 @@ void Storage::ProcessMat_(double cap){
   }
 }
 
+//- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Storage::CoalesceStocks_() {
+  using cyclus::toolkit::MatVec;
+
+  // absorbing a material of identical composition creates no new
+  // composition, so this only merges lots and keeps mass balance exact
+  MatVec mats = stocks.PopN(stocks.count());
+  MatVec merged;
+  std::map<int, int> group;
+  for (int i = 0; i < mats.size(); ++i) {
+    std::map<int, int>::iterator it = group.find(mats[i]->comp()->id());
+    if (it == group.end()) {
+      group[mats[i]->comp()->id()] = merged.size();
+      merged.push_back(mats[i]);
+    } else {
+      merged[it->second]->Absorb(mats[i]);
+    }
+  }
+  stocks.Push(merged);
+}
+
 //- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Storage::ReadyMatl_(int time) {
   using cyclus::toolkit::ResBuf;
 
   int to_ready = 0;
 
-  while(!entry_times.empty() && entry_times.front()<=time){
-    entry_times.pop_front();
-    ++to_ready;
+  // cohorts are keyed by entry time, so the ready ones are at the front
+  std::map<int, int>::iterator it = cohort_counts.begin();
+  while (it != cohort_counts.end() && it->first <= time) {
+    to_ready += it->second;
+    cohort_counts.erase(it++);
   }
 
-  ready.Push(processing.PopN(to_ready));
+  cyclus::toolkit::MatVec mats = processing.PopN(to_ready);
+  if (decay_on_release) {
+    // one decay to the current time (from each material's last decay)
+    // reuses the decayed composition each composition caches for a given
+    // time span, shared by every material (and facility) holding it
+    for (int i = 0; i < mats.size(); ++i) {
+      mats[i]->Decay(context()->time());
+    }
+  }
+  ready.Push(mats);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
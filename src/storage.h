@@ -2,7 +2,7 @@
 #define CYCLUS_STORAGES_STORAGE_H_
 
 #include <string>
-#include <list>
+#include <map>
 #include <vector>
 
 #include "cyclus.h"
@@ -111,6 +111,9 @@ class Storage
   /// @param cap current throughput capacity 
   void ProcessMat_(double cap);
 
+  /// @brief combine stocks materials that share a composition
+  void CoalesceStocks_();
+
   /// @brief move ready resources from processing to ready at a certain time
   /// @param time the time of interest
   void ReadyMatl_(int time);
@@ -182,6 +185,27 @@ class Storage
                       "uilabel":"Batch Handling"}
   bool discrete_handling;                    
 
+  #pragma cyclus var {"default": False,\
+                      "tooltip":"Bool to combine stocks of identical composition",\
+                      "doc":"If true, materials entering stocks are combined with stocks of the "\
+                      "same composition, so that stocks (and the bids made from them) scale "\
+                      "with the number of distinct compositions rather than the number of "\
+                      "batches received. Cannot be combined with discrete batch handling.",\
+                      "userlevel": 10,\
+                      "uilabel":"Coalesce Stocks"}
+  bool coalesce_stocks;
+
+  #pragma cyclus var {"default": False,\
+                      "tooltip":"Bool to decay material on release",\
+                      "doc":"If true, material is decayed to the current time once it has "\
+                      "completed its residence time and moves towards stocks. Decay runs from "\
+                      "when the material was created or last decayed, so it also covers any "\
+                      "time before it entered storage. Otherwise the composition of stored "\
+                      "material is left unchanged.",\
+                      "userlevel": 10,\
+                      "uilabel":"Decay on Release"}
+  bool decay_on_release;
+
   #pragma cyclus var {"tooltip":"Incoming material buffer"}
   cyclus::toolkit::ResBuf<cyclus::Material> inventory;
 
@@ -191,10 +215,11 @@ class Storage
   #pragma cyclus var {"tooltip":"Buffer for material held for required residence_time"}
   cyclus::toolkit::ResBuf<cyclus::Material> ready;
 
-  //// list of input times for materials entering the processing buffer
-  #pragma cyclus var{"default": [],\
+  //// residence cohorts: number of materials entering the processing buffer
+  //// at each time step (the processing buffer holds them in entry order)
+  #pragma cyclus var{"default": {},\
                       "internal": True}
-  std::list<int> entry_times;
+  std::map<int, int> cohort_counts;
 
   #pragma cyclus var {"tooltip":"Buffer for material still waiting for required residence_time"}
   cyclus::toolkit::ResBuf<cyclus::Material> processing;
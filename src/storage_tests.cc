@@ -23,6 +23,8 @@ void StorageTest::InitParameters(){
   max_inv_size = 200;
   throughput = 20;
   discrete_handling = 0;
+  coalesce_stocks = 0;
+  decay_on_release = 0;
 
   cyclus::CompMap v;
   v[922350000] = 1;
@@ -39,6 +41,8 @@ void StorageTest::SetUpStorage(){
   src_facility_->max_inv_size = max_inv_size;
   src_facility_->throughput = throughput;
   src_facility_->discrete_handling = discrete_handling;
+  src_facility_->coalesce_stocks = coalesce_stocks;
+  src_facility_->decay_on_release = decay_on_release;
 }
 
 void StorageTest::TestInitState(Storage* fac){
@@ -81,6 +85,21 @@ void StorageTest::TestCurrentCap(Storage* fac, double inv){
   EXPECT_EQ(inv, fac->current_capacity());
 }
 
+void StorageTest::TestCohorts(Storage* fac, std::map<int, int> counts){
+
+  EXPECT_EQ(counts, fac->cohort_counts);
+}
+
+void StorageTest::TestStocksCount(Storage* fac, int n){
+
+  EXPECT_EQ(n, fac->stocks.count());
+}
+
+cyclus::Material::Ptr StorageTest::PopStocks(Storage* fac){
+
+  return cyclus::ResCast<Material>(fac->stocks.PopBack());
+}
+
 void StorageTest::TestReadyTime(Storage* fac, int t){
 
   EXPECT_EQ(t, fac->ready_time());
@@ -246,6 +265,106 @@ TEST_F(StorageTest, MultipleSmallBatches) {
 }
 
 
+TEST_F(StorageTest, Cohorts) {
+  // Materials entering processing in the same time step share one cohort
+  double cap = throughput;
+  cyclus::Composition::Ptr rec = tc_.get()->GetRecipe(in_r1);
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.1*cap, rec));
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.2*cap, rec));
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.3*cap, rec));
+  src_facility_->Tock();
+
+  tc_.get()->time(1);
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.25*cap, rec));
+  src_facility_->Tock();
+
+  std::map<int, int> counts;
+  counts[0] = 3;
+  counts[1] = 1;
+  TestCohorts(src_facility_, counts);
+
+  // the first cohort leaves processing as a whole
+  tc_.get()->time(residence_time);
+  src_facility_->Tock();
+  counts.erase(0);
+  TestCohorts(src_facility_, counts);
+  TestBuffers(src_facility_,0,0.25*cap,0,0.6*cap);
+}
+
+TEST_F(StorageTest, DiscretePrefix) {
+  // With discrete handling, the longest run of whole materials that fits in
+  // the throughput moves to stocks and the rest stays ready, in order
+  discrete_handling = 1;
+  residence_time = 0;
+  SetUpStorage();
+
+  double cap = throughput;
+  cyclus::Composition::Ptr rec = tc_.get()->GetRecipe(in_r1);
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.3*cap, rec));
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.5*cap, rec));
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.4*cap, rec));
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.1*cap, rec));
+
+  src_facility_->Tock();
+  TestBuffers(src_facility_,0,0,0.5*cap,0.8*cap);
+
+  tc_.get()->time(1);
+  src_facility_->Tock();
+  TestBuffers(src_facility_,0,0,0,1.3*cap);
+}
+
+TEST_F(StorageTest, CoalesceStocks) {
+  // stocks of the same composition are combined, others are kept apart
+  coalesce_stocks = 1;
+  residence_time = 0;
+  SetUpStorage();
+
+  double cap = throughput;
+  cyclus::Composition::Ptr rec = tc_.get()->GetRecipe(in_r1);
+  cyclus::CompMap v;
+  v[922350000] = 1;
+  cyclus::Composition::Ptr other = cyclus::Composition::CreateFromAtom(v);
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.2*cap, rec));
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.3*cap, rec));
+  src_facility_->Tock();
+  TestStocksCount(src_facility_, 1);
+
+  tc_.get()->time(1);
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.25*cap, rec));
+  src_facility_->Tock();
+  TestStocksCount(src_facility_, 1);
+
+  tc_.get()->time(2);
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(0.1*cap, other));
+  src_facility_->Tock();
+  TestStocksCount(src_facility_, 2);
+  TestBuffers(src_facility_,0,0,0,0.85*cap);
+}
+
+TEST_F(StorageTest, DecayOnRelease) {
+  // material created when it enters storage decays over its residence time
+  // once it is released
+  decay_on_release = 1;
+  SetUpStorage();
+
+  cyclus::CompMap v;
+  v[10030000] = 1;
+  cyclus::Composition::Ptr h3 = cyclus::Composition::CreateFromMass(v);
+  double qty = 10;
+  TestAddMat(src_facility_, cyclus::Material::CreateUntracked(qty, h3));
+  src_facility_->Tock();
+
+  tc_.get()->time(residence_time);
+  src_facility_->Tock();
+  TestBuffers(src_facility_,0,0,0,qty);
+
+  cyclus::Material::Ptr m = PopStocks(src_facility_);
+  cyclus::toolkit::MatQuery mq(m);
+  // tritium has a half-life of about 12.3 years
+  EXPECT_LT(mq.mass(10030000), 0.99 * qty);
+  EXPECT_GT(mq.mass(10030000), 0.9 * qty);
+}
+
 TEST_F(StorageTest, ChangeCapacity) {
   // src_facility_->discrete_handling_(0);
   max_inv_size = 10000;
@@ -28,13 +28,16 @@ class StorageTest : public ::testing::Test {
   void TestStocks(storage::Storage* fac, cyclus::CompMap v);
   void TestReadyTime(storage::Storage* fac, int t);
   void TestCurrentCap(storage::Storage* fac, double inv);
+  void TestCohorts(storage::Storage* fac, std::map<int, int> counts);
+  void TestStocksCount(storage::Storage* fac, int n);
+  cyclus::Material::Ptr PopStocks(storage::Storage* fac);
 
   std::vector<std::string> in_c1, out_c1;
   std::string in_r1;
 
   int residence_time;
   double throughput, max_inv_size;
-  bool discrete_handling;
+  bool discrete_handling, coalesce_stocks, decay_on_release;
 };
 } // namespace storage
 #endif // STORAGE_TESTS_H_